@@ -2548,29 +2548,62 @@ SysRes VG_(am_mmap_anon_float_client) ( SizeT length, Int prot )
    return am_mmap_anon_float_client (length, prot, False /* isCH */);
 }
 
+/* The size of a transparent huge page.  This is right for x86, arm64
+   and s390x with 4K pages.  On other platforms it only makes the
+   mappings a bit more aligned than needed. */
+#define AM_HUGEPAGE_SZB (2 * 1024 * 1024)
+
+/* Set once MADV_HUGEPAGE has failed, e.g. because the kernel has no
+   transparent huge page support; then we don't try any more. */
+static Bool hugepages_unavailable = False;
+
+static void am_advise_hugepages ( Addr start, SizeT length )
+{
+#  if defined(VGO_linux)
+   SysRes sres;
+
+   if (hugepages_unavailable)
+      return;
+   sres = VG_(do_syscall3)(__NR_madvise, start, length, VKI_MADV_HUGEPAGE);
+   if (sr_isError(sres)) {
+      VG_(debugLog)(1, "aspacem",
+                    "madvise(MADV_HUGEPAGE) failed (error %lu), "
+                    "not using huge pages\n", sr_Err(sres));
+      hugepages_unavailable = True;
+   }
+#  endif
+}
+
 /* Map anonymously at an unconstrained address for V, and update the
-   segment array accordingly.  This is fundamentally how V allocates
-   itself more address space when needed. */
+   segment array accordingly.  If 'huge', align the mapping on a huge
+   page boundary and ask the kernel to back it with huge pages.  Only
+   [start, start+length) is mapped and recorded in the segment array;
+   the extra space asked for to be able to align the start is left
+   free. */
 
-SysRes VG_(am_mmap_anon_float_valgrind)( SizeT length )
+static SysRes am_mmap_anon_float_valgrind( SizeT length, Bool huge )
 {
    SysRes     sres;
    NSegment   seg;
    Addr       advised;
    Bool       ok;
    MapRequest req;
+   SizeT      align;
  
    /* Not allowable. */
    if (length == 0)
       return VG_(mk_SysRes_Error)( VKI_EINVAL );
 
+   align = huge ? AM_HUGEPAGE_SZB : VKI_PAGE_SIZE;
+
    /* Ask for an advisory.  If it's negative, fail immediately. */
    req.rkind = MAny;
    req.start = 0;
-   req.len   = length;
+   req.len   = VG_PGROUNDUP(length) + (align - VKI_PAGE_SIZE);
    advised = VG_(am_get_advisory)( &req, False/*forClient*/, &ok );
    if (!ok)
       return VG_(mk_SysRes_Error)( VKI_EINVAL );
+   advised = VG_ROUNDUP(advised, align);
 
 // On Darwin, for anonymous maps you can pass in a tag which is used by
 // programs like vmmap for statistical purposes.
@@ -2641,16 +2674,63 @@ SysRes VG_(am_mmap_anon_float_valgrind)( SizeT length )
    seg.hasX  = True;
    add_segment( &seg );
 
+   if (huge)
+      am_advise_hugepages( seg.start, seg.end + 1 - seg.start );
+
    AM_SANITY_CHECK;
    return sres;
 }
 
-/* Really just a wrapper around VG_(am_mmap_anon_float_valgrind). */
+/* Map anonymously at an unconstrained address for V, and update the
+   segment array accordingly.  This is fundamentally how V allocates
+   itself more address space when needed. */
+
+SysRes VG_(am_mmap_anon_float_valgrind)( SizeT length )
+{
+   return am_mmap_anon_float_valgrind( length, False/*huge*/ );
+}
+
+/* As VG_(am_mmap_anon_float_valgrind), but with --huge-pages=yes try to
+   have the mapping backed by transparent huge pages. */
+
+SysRes VG_(am_mmap_anon_float_valgrind_huge)( SizeT length )
+{
+   Bool huge = VG_(clo_huge_pages) && !hugepages_unavailable
+               && length >= AM_HUGEPAGE_SZB;
+   return am_mmap_anon_float_valgrind( length, huge );
+}
+
+/* With --huge-pages=yes, shadow allocations smaller than a huge page
+   (e.g. memcheck's secondary maps) are carved out of huge page sized
+   chunks, so that they share huge pages rather than each getting
+   their own small mapping.  A carved out block can still be unmapped
+   on its own: the segment array is then updated as for any partial
+   unmap.  Space carved out is never handed out again. */
+static Addr shadow_chunk_next = 0;
+static Addr shadow_chunk_end  = 0;
 
 void* VG_(am_shadow_alloc)(SizeT size)
 {
-   SysRes sres = VG_(am_mmap_anon_float_valgrind)( size );
-   return sr_isError(sres) ? NULL : (void*)sr_Res(sres);
+   SysRes sres;
+   Addr   res;
+
+   if (!VG_(clo_huge_pages) || hugepages_unavailable
+       || size >= AM_HUGEPAGE_SZB) {
+      sres = VG_(am_mmap_anon_float_valgrind_huge)( size );
+      return sr_isError(sres) ? NULL : (void*)sr_Res(sres);
+   }
+
+   size = VG_PGROUNDUP(size);
+   if (shadow_chunk_end - shadow_chunk_next < size) {
+      sres = am_mmap_anon_float_valgrind( AM_HUGEPAGE_SZB, True/*huge*/ );
+      if (sr_isError(sres))
+         return NULL;
+      shadow_chunk_next = sr_Res(sres);
+      shadow_chunk_end  = shadow_chunk_next + AM_HUGEPAGE_SZB;
+   }
+   res = shadow_chunk_next;
+   shadow_chunk_next += size;
+   return (void*)res;
 }
 
 /* Map a file at an unconstrained address for V, and update the
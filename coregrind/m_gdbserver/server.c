@@ -170,6 +170,7 @@ void VG_(print_all_stats) (Bool memory_stats, Bool tool_stats)
    VG_(print_translation_stats)();
    VG_(print_tt_tc_stats)();
    VG_(print_scheduler_stats)();
+   VG_(print_syscall_stats)();
    VG_(print_ExeContext_stats)( False /* with_stacktraces */ );
    VG_(print_errormgr_stats)();
    if (tool_stats && VG_(needs).print_stats) {
@@ -246,7 +247,9 @@ int handle_gdb_valgrind_command (char *mon, OutputSink *sink_wanted_at_return)
 "  v.info memory [aspacemgr] : show valgrind heap memory stats\n"
 "     (with aspacemgr arg, also shows valgrind segments on log output)\n"
 "  v.info exectxt          : show stacktraces and stats of all execontexts\n"
-"  v.info scheduler        : show valgrind thread state and stacktrace\n"
+"  v.info scheduler [stats|csv] : show valgrind thread state and stacktrace\n"
+"     (with stats or csv arg, show per-thread scheduling latencies instead,\n"
+"      only if --sched-stats=yes)\n"
 "  v.info stats            : show various valgrind and tool stats\n"
 "  v.info unwind <addr> [<len>] : show unwind debug info for <addr> .. <addr+len>\n"
 "  v.set debuglog <level>  : set valgrind debug log level to <level>\n"
@@ -408,9 +411,28 @@ int handle_gdb_valgrind_command (char *mon, OutputSink *sink_wanted_at_return)
          ret = 1;
          break;
       case  5: /* scheduler */
-         VG_(show_sched_status) (True,  // host_stacktrace
-                                 True,  // stack_usage
-                                 True); // exited_threads
+         wcmd = strtok_r (NULL, " ", &ssaveptr);
+         if (wcmd == NULL) {
+            VG_(show_sched_status) (True,  // host_stacktrace
+                                    True,  // stack_usage
+                                    True); // exited_threads
+         } else {
+            switch (int_value = VG_(keyword_id) ("stats csv", wcmd,
+                                                 kwd_report_all)) {
+            case -2:
+            case -1: break;
+            case  0: /* stats */
+            case  1: /* csv */
+               if (VG_(clo_sched_stats))
+                  VG_(print_sched_thread_stats) (int_value == 1);
+               else
+                  VG_(gdb_printf)
+                     ("Valgrind must be started with --sched-stats=yes"
+                      " to show scheduling stats\n");
+               break;
+            default: vg_assert (0);
+            }
+         }
          ret = 1;
          break;
       case  6: /* stats */
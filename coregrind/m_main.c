@@ -183,7 +183,11 @@ static void usage_NORETURN ( Bool debug_help )
 "         where hint is one of:\n"
 "           lax-ioctls lax-doors fuse-compatible enable-outer\n"
 "           no-inner-prefix no-nptl-pthread-stackcache none\n"
-"    --fair-sched=no|yes|try   schedule threads fairly on multicore systems [no]\n"
+"    --fair-sched=no|yes|try|queue  schedule threads fairly on multicore\n"
+"                              systems [no]\n"
+"    --fair-sched-handoff=fifo|node|cpu  with --fair-sched=queue, prefer\n"
+"                              handing the CPU to a thread on the same\n"
+"                              NUMA node or CPU [fifo]\n"
 "    --kernel-variant=variant1,variant2,...\n"
 "         handle non-standard kernel variants [none]\n"
 "         where variant is one of:\n"
@@ -195,6 +199,8 @@ static void usage_NORETURN ( Bool debug_help )
 "           more sectors may increase performance, but use more memory.\n"
 "    --avg-transtab-entry-size=<number> avg size in bytes of a translated\n"
 "           basic block [0, meaning use tool provided default]\n"
+"    --huge-pages=no|yes       back translated code and shadow memory with\n"
+"                              transparent huge pages if possible [no]\n"
 "    --aspace-minaddr=0xPP     avoid mapping memory below 0xPP [guessed]\n"
 "    --valgrind-stacksize=<number> size of valgrind (host) thread's stack\n"
 "                               (in bytes) ["
@@ -243,6 +249,7 @@ static void usage_NORETURN ( Bool debug_help )
 "    --debug-dump=frames       mimic /usr/bin/readelf --debug-dump=frames\n"
 "    --trace-redir=no|yes      show redirection details? [no]\n"
 "    --trace-sched=no|yes      show thread scheduler details? [no]\n"
+"    --sched-stats=no|yes      record per-thread scheduling latencies? [no]\n"
 "    --profile-heap=no|yes     profile Valgrind's own space use\n"
 "    --core-redzone-size=<number>  set minimum size of redzones added before/after\n"
 "                              heap blocks allocated for Valgrind internal use (in bytes) [4]\n"
@@ -661,11 +668,20 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
             VG_(clo_fair_sched) = try_fair_sched;
          else if (VG_(strcmp)(tmp_str, "no") == 0)
             VG_(clo_fair_sched) = disable_fair_sched;
+         else if (VG_(strcmp)(tmp_str, "queue") == 0)
+            VG_(clo_fair_sched) = queue_fair_sched;
          else
             VG_(fmsg_bad_option)(arg,
-               "Bad argument, should be 'yes', 'try' or 'no'\n");
+               "Bad argument, should be 'yes', 'try', 'queue' or 'no'\n");
       }
+      else if VG_XACT_CLO(arg, "--fair-sched-handoff=fifo",
+                          VG_(clo_fair_sched_handoff), fifo_sched_handoff) {}
+      else if VG_XACT_CLO(arg, "--fair-sched-handoff=node",
+                          VG_(clo_fair_sched_handoff), node_sched_handoff) {}
+      else if VG_XACT_CLO(arg, "--fair-sched-handoff=cpu",
+                          VG_(clo_fair_sched_handoff), cpu_sched_handoff) {}
       else if VG_BOOL_CLO(arg, "--trace-sched",      VG_(clo_trace_sched)) {}
+      else if VG_BOOL_CLO(arg, "--sched-stats",      VG_(clo_sched_stats)) {}
       else if VG_BOOL_CLO(arg, "--trace-signals",    VG_(clo_trace_signals)) {}
       else if VG_BOOL_CLO(arg, "--trace-symtab",     VG_(clo_trace_symtab)) {}
       else if VG_STR_CLO (arg, "--trace-symtab-patt", VG_(clo_trace_symtab_patt)) {}
@@ -695,6 +711,7 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
       else if VG_BINT_CLO(arg, "--avg-transtab-entry-size",
                                VG_(clo_avg_transtab_entry_size),
                                50, 5000) {}
+      else if VG_BOOL_CLO(arg, "--huge-pages",       VG_(clo_huge_pages)) {}
       else if VG_BINT_CLO(arg, "--merge-recursive-frames",
                                VG_(clo_merge_recursive_frames), 0,
                                VG_DEEPEST_BACKTRACE) {}
@@ -950,6 +967,13 @@ void main_process_cmd_line_options ( /*OUT*/Bool* logging_to_fd,
          "because it doesn't generate errors.\n", VG_(details).name);
    }
 
+   if (VG_(clo_fair_sched_handoff) != fifo_sched_handoff
+       && VG_(clo_fair_sched) != queue_fair_sched) {
+      VG_(fmsg_bad_option)("--fair-sched-handoff=node or =cpu",
+         "--fair-sched-handoff= can only be used with --fair-sched=queue.\n");
+      /*NOTREACHED*/
+   }
+
 #  if !defined(VGO_darwin)
    if (VG_(clo_resync_filter) != 0) {
       VG_(fmsg_bad_option)("--resync-filter=yes or =verbose", 
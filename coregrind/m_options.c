@@ -106,7 +106,10 @@ Bool   VG_(clo_debug_dump_frames) = False;
 Bool   VG_(clo_trace_redir)    = False;
 enum FairSchedType
        VG_(clo_fair_sched)     = disable_fair_sched;
+enum SchedHandoffType
+       VG_(clo_fair_sched_handoff) = fifo_sched_handoff;
 Bool   VG_(clo_trace_sched)    = False;
+Bool   VG_(clo_sched_stats)    = False;
 Bool   VG_(clo_profile_heap)   = False;
 Int    VG_(clo_core_redzone_size) = CORE_REDZONE_DEFAULT_SZB;
 // A value != -1 overrides the tool-specific value
@@ -129,6 +132,7 @@ Word   VG_(clo_max_stackframe) = 2000000;
 UInt   VG_(clo_max_threads)    = MAX_THREADS_DEFAULT;
 Word   VG_(clo_main_stacksize) = 0; /* use client's rlimit.stack */
 Word   VG_(clo_valgrind_stacksize) = VG_DEFAULT_STACK_ACTIVE_SZB;
+Bool   VG_(clo_huge_pages)     = False;
 Bool   VG_(clo_wait_for_gdb)   = False;
 UInt   VG_(clo_kernel_variant) = 0;
 Bool   VG_(clo_dsymutil)       = True;
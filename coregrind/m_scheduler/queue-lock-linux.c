@@ -0,0 +1,327 @@
+/*--------------------------------------------------------------------*/
+/*--- Linux queue lock implementation           queue-lock-linux.c ---*/
+/*---                                                              ---*/
+/*--- A FIFO lock in which each waiter sleeps on its own futex and ---*/
+/*--- the lock is handed over directly to exactly one waiter. The  ---*/
+/*--- handoff can optionally prefer a waiter that last ran on the  ---*/
+/*--- same CPU or NUMA node as the releasing thread.               ---*/
+/*--------------------------------------------------------------------*/
+
+/*
+   This file is part of Valgrind, a dynamic binary instrumentation
+   framework.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2 of the
+   License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+   02111-1307, USA.
+
+   The GNU General Public License is contained in the file COPYING.
+*/
+
+#include "pub_core_basics.h"
+#include "pub_core_libcassert.h"
+#include "pub_core_libcbase.h"     // VG_(memset)()
+#include "pub_core_libcprint.h"
+#include "pub_core_syscall.h"
+#include "pub_core_vki.h"
+#include "pub_core_vkiscnums.h"    // __NR_futex, __NR_getcpu
+#include "pub_core_libcproc.h"
+#include "pub_core_mallocfree.h"
+#include "pub_core_options.h"      // VG_(clo_fair_sched_handoff)
+#include "pub_core_threadstate.h"  // VG_N_THREADS
+#include "pub_core_inner.h"
+#if defined(ENABLE_INNER_CLIENT_REQUEST)
+#include "helgrind/helgrind.h"
+#endif
+#include "priv_sched-lock.h"
+#include "priv_sched-lock-impl.h"
+
+/* Maximum number of consecutive handoffs that may skip the waiter at
+   the head of the queue in favour of one on the same CPU or node.
+   This bounds the unfairness of --fair-sched-handoff=cpu|node. */
+#define QL_MAX_BYPASS 8
+
+#define QL_NO_SLOT (-1)
+
+/* A waiter slot.  A thread waiting for the lock owns one slot and
+   sleeps on its futex word until the releasing thread sets it to 1,
+   at which point the waiter owns the lock.  Slots are only linked and
+   unlinked with qlock held. */
+struct ql_waiter {
+   volatile unsigned futex;
+   int next;
+   int cpu;
+   int node;
+};
+
+struct sched_lock {
+   /* Protects all fields below except owner, and the 'next', 'cpu'
+      and 'node' fields of the slots.  Only ever held for a few
+      instructions (or a scan of the waiters, on release). */
+   volatile unsigned qlock;
+   Bool locked;
+   int head;        /* first waiter, or QL_NO_SLOT */
+   int tail;        /* last waiter, or QL_NO_SLOT */
+   int free_slots;  /* list of unused slots, chained by 'next' */
+   unsigned n_bypassed;
+   int n_slots;
+   struct ql_waiter *slot;
+   int owner;
+};
+
+#if 1
+static Bool s_debug;
+#else
+static Bool s_debug = True;
+#endif
+
+static const HChar *get_sched_lock_name(void)
+{
+   switch (VG_(clo_fair_sched_handoff)) {
+   case cpu_sched_handoff:  return "queue lock (same-CPU handoff)";
+   case node_sched_handoff: return "queue lock (same-node handoff)";
+   default:                 return "queue lock";
+   }
+}
+
+static void get_cpu_and_node(int *cpu, int *node)
+{
+   unsigned c = 0, n = 0;
+   SysRes sres;
+
+   *cpu  = -1;
+   *node = -1;
+   if (VG_(clo_fair_sched_handoff) == fifo_sched_handoff)
+      return;
+   sres = VG_(do_syscall3)(__NR_getcpu, (UWord)&c, (UWord)&n, 0);
+   if (!sr_isError(sres)) {
+      *cpu  = c;
+      *node = n;
+   }
+}
+
+static void qlock_acquire(struct sched_lock *p)
+{
+   unsigned spins = 0;
+
+   while (__sync_lock_test_and_set(&p->qlock, 1)) {
+      while (p->qlock) {
+         /* The holder may have been preempted; don't burn its CPU. */
+         if (++spins % 1000 == 0)
+            VG_(do_syscall0)(__NR_sched_yield);
+      }
+   }
+}
+
+static void qlock_release(struct sched_lock *p)
+{
+   __sync_lock_release(&p->qlock);
+}
+
+static struct sched_lock *create_sched_lock(void)
+{
+   struct sched_lock *p;
+   int i;
+
+   p = VG_(malloc)("sched_lock", sizeof(*p));
+   VG_(memset)(p, 0, sizeof(*p));
+
+   // The futex syscall requires that a futex takes four bytes.
+   vg_assert(sizeof(p->slot[0].futex) == 4);
+
+   /* A thread can wait for the lock at most once at a time, so one
+      slot per possible thread suffices. */
+   p->n_slots = VG_N_THREADS + 1;
+   p->slot = VG_(malloc)("sched_lock.slot", p->n_slots * sizeof(p->slot[0]));
+   VG_(memset)(p->slot, 0, p->n_slots * sizeof(p->slot[0]));
+   for (i = 0; i < p->n_slots; i++)
+      p->slot[i].next = i + 1 < p->n_slots ? i + 1 : QL_NO_SLOT;
+   p->free_slots = 0;
+   p->head = QL_NO_SLOT;
+   p->tail = QL_NO_SLOT;
+
+   INNER_REQUEST(ANNOTATE_RWLOCK_CREATE(p));
+   INNER_REQUEST(ANNOTATE_BENIGN_RACE_SIZED(p->slot,
+                                            p->n_slots * sizeof(p->slot[0]),
+                                            ""));
+   return p;
+}
+
+static void destroy_sched_lock(struct sched_lock *p)
+{
+   INNER_REQUEST(ANNOTATE_RWLOCK_DESTROY(p));
+   VG_(free)(p->slot);
+   VG_(free)(p);
+}
+
+static int get_sched_lock_owner(struct sched_lock *p)
+{
+   return p->owner;
+}
+
+/*
+ * Acquire the queue lock.  If it is free, take it.  Otherwise append a
+ * slot to the queue of waiters and sleep on that slot's futex until the
+ * releasing thread hands the lock over.  Since every waiter has its own
+ * futex, a release wakes up exactly one thread.
+ */
+static void acquire_sched_lock(struct sched_lock *p)
+{
+   int me, cpu, node;
+   SysRes sres;
+
+   qlock_acquire(p);
+   if (!p->locked) {
+      p->locked = True;
+      qlock_release(p);
+   } else {
+      /* Only waiters need to know where they run.  Query that without
+         holding qlock, then recheck whether the lock is still taken. */
+      cpu = node = -1;
+      if (VG_(clo_fair_sched_handoff) != fifo_sched_handoff) {
+         qlock_release(p);
+         get_cpu_and_node(&cpu, &node);
+         qlock_acquire(p);
+         if (!p->locked) {
+            p->locked = True;
+            qlock_release(p);
+            goto acquired;
+         }
+      }
+      me = p->free_slots;
+      vg_assert(me != QL_NO_SLOT);
+      p->free_slots = p->slot[me].next;
+      p->slot[me].futex = 0;
+      p->slot[me].next  = QL_NO_SLOT;
+      p->slot[me].cpu   = cpu;
+      p->slot[me].node  = node;
+      if (p->tail == QL_NO_SLOT)
+         p->head = me;
+      else
+         p->slot[p->tail].next = me;
+      p->tail = me;
+      qlock_release(p);
+
+      if (s_debug)
+         VG_(printf)("[%d/%d] acquire: waiting in slot %d\n", VG_(getpid)(),
+                     VG_(gettid)(), me);
+      while (p->slot[me].futex == 0) {
+         sres = VG_(do_syscall3)(__NR_futex, (UWord)&p->slot[me].futex,
+                                 VKI_FUTEX_WAIT | VKI_FUTEX_PRIVATE_FLAG, 0);
+         if (sr_isError(sres) && sr_Err(sres) != VKI_EAGAIN
+             && sr_Err(sres) != VKI_EINTR) {
+            VG_(printf)("futex_wait() returned error code %lu\n",
+                        sr_Err(sres));
+            vg_assert(False);
+         }
+      }
+      __sync_synchronize();
+
+      /* We own the lock now; give the slot back. */
+      qlock_acquire(p);
+      p->slot[me].next = p->free_slots;
+      p->free_slots = me;
+      qlock_release(p);
+   }
+
+  acquired:
+   __sync_synchronize();
+   INNER_REQUEST(ANNOTATE_RWLOCK_ACQUIRED(p, /*is_w*/1));
+   vg_assert(p->owner == 0);
+   p->owner = VG_(gettid)();
+}
+
+/*
+ * Release the queue lock.  If nobody is waiting the lock becomes free.
+ * Otherwise it stays locked and ownership passes to one waiter: the
+ * head of the queue, or, with --fair-sched-handoff=cpu|node, the first
+ * waiter that last ran on the same CPU or node as this thread, unless
+ * the head has already been passed over QL_MAX_BYPASS times in a row.
+ */
+static void release_sched_lock(struct sched_lock *p)
+{
+   int cpu, node, prev, w, w_prev;
+   SysRes sres;
+
+   vg_assert(p->owner != 0);
+   p->owner = 0;
+   INNER_REQUEST(ANNOTATE_RWLOCK_RELEASED(p, /*is_w*/1));
+
+   qlock_acquire(p);
+   if (p->head == QL_NO_SLOT) {
+      p->locked = False;
+      qlock_release(p);
+      if (s_debug)
+         VG_(printf)("[%d/%d] release: no thread is waiting\n",
+                     VG_(getpid)(), VG_(gettid)());
+      return;
+   }
+
+   /* Only worth asking where we run if some waiter could be preferred
+      over the head of the queue. */
+   cpu = node = -1;
+   if (p->n_bypassed < QL_MAX_BYPASS && p->slot[p->head].next != QL_NO_SLOT)
+      get_cpu_and_node(&cpu, &node);
+
+   w = p->head;
+   w_prev = QL_NO_SLOT;
+   if (cpu >= 0 && p->n_bypassed < QL_MAX_BYPASS) {
+      for (prev = QL_NO_SLOT, w = p->head; w != QL_NO_SLOT;
+           prev = w, w = p->slot[w].next) {
+         if (VG_(clo_fair_sched_handoff) == cpu_sched_handoff
+             ? p->slot[w].cpu == cpu : p->slot[w].node == node)
+            break;
+      }
+      w_prev = prev;
+      if (w == QL_NO_SLOT) {
+         w = p->head;
+         w_prev = QL_NO_SLOT;
+      }
+   }
+   if (w == p->head)
+      p->n_bypassed = 0;
+   else
+      p->n_bypassed++;
+
+   if (w_prev == QL_NO_SLOT)
+      p->head = p->slot[w].next;
+   else
+      p->slot[w_prev].next = p->slot[w].next;
+   if (p->tail == w)
+      p->tail = w_prev;
+   qlock_release(p);
+
+   if (s_debug)
+      VG_(printf)("[%d/%d] release: handing over to slot %d\n",
+                  VG_(getpid)(), VG_(gettid)(), w);
+
+   /* After this store the slot belongs to the new owner, which may
+      already have recycled it by the time the wakeup is sent.  A
+      spurious wakeup is harmless though: the waiter rechecks its
+      futex word. */
+   __sync_synchronize();
+   p->slot[w].futex = 1;
+   sres = VG_(do_syscall3)(__NR_futex, (UWord)&p->slot[w].futex,
+                           VKI_FUTEX_WAKE | VKI_FUTEX_PRIVATE_FLAG, 1);
+   vg_assert(!sr_isError(sres));
+}
+
+const struct sched_lock_ops ML_(linux_queue_lock_ops) = {
+   .get_sched_lock_name  = get_sched_lock_name,
+   .create_sched_lock    = create_sched_lock,
+   .destroy_sched_lock   = destroy_sched_lock,
+   .get_sched_lock_owner = get_sched_lock_owner,
+   .acquire_sched_lock   = acquire_sched_lock,
+   .release_sched_lock   = release_sched_lock,
+};
@@ -43,6 +43,9 @@ static struct sched_lock_ops const *const sched_lock_impl[] = {
 #ifdef ENABLE_LINUX_TICKET_LOCK
    [sched_lock_ticket]  = &ML_(linux_ticket_lock_ops),
 #endif
+#ifdef ENABLE_LINUX_QUEUE_LOCK
+   [sched_lock_queue]   = &ML_(linux_queue_lock_ops),
+#endif
 };
 
 /**
@@ -145,6 +145,156 @@ static ULong stats__n_xindir_misses = 0;
 static UInt sanity_fast_count = 0;
 static UInt sanity_slow_count = 0;
 
+/* Per-thread scheduling stats, gathered only if --sched-stats=yes, as
+   it costs two clock reads per the_BigLock handoff.  Times are in
+   microseconds.  Histogram bucket 0 counts zero values, and bucket i
+   (i >= 1) counts values in [2^(i-1), 2^i); the last bucket also
+   counts everything larger. */
+#define N_SCHED_HIST 24
+
+typedef
+   struct {
+      ULong n_acquires;     /* times the_BigLock was acquired */
+      ULong lock_wait_us;   /* total time spent waiting for it */
+      ULong run_us;         /* total time spent holding it */
+      ULong syscall_us;     /* total time it was released for syscalls */
+      ULong n_syscalls;     /* releases for a (maybe blocking) syscall */
+      ULong n_yields;       /* releases in Yielding state */
+      ULong n_involuntary;  /* .. of which due to the quantum running out */
+      ULong n_fastmiss;     /* fast-cache misses */
+
+      /* State of the current timeslice. */
+      ULong acquired_at;
+      ULong released_at;
+      Bool  released_for_syscall;
+      UInt  slice_fastmiss;
+
+      UInt  hist_lock_wait[N_SCHED_HIST];
+      UInt  hist_timeslice[N_SCHED_HIST];
+      UInt  hist_syscall[N_SCHED_HIST];
+      UInt  hist_fastmiss[N_SCHED_HIST]; /* misses per timeslice */
+   }
+   SchedStats;
+
+/* [VG_N_THREADS], or NULL if --sched-stats=no. */
+static SchedStats* sched_stats = NULL;
+
+static void sched_hist_add ( UInt* hist, ULong val )
+{
+   UInt b = 0;
+   while (val > 0 && b < N_SCHED_HIST-1) {
+      val >>= 1;
+      b++;
+   }
+   hist[b]++;
+}
+
+/* Called with the_BigLock just acquired by tid, which started waiting
+   for it at wait_start. */
+static void sched_stats_acquired ( ThreadId tid, ULong wait_start )
+{
+   SchedStats* st  = &sched_stats[tid];
+   ULong       now = VG_(read_microsecond_timer)();
+
+   st->n_acquires++;
+   st->lock_wait_us += now - wait_start;
+   sched_hist_add(st->hist_lock_wait, now - wait_start);
+
+   if (st->released_for_syscall && wait_start >= st->released_at) {
+      st->syscall_us += wait_start - st->released_at;
+      sched_hist_add(st->hist_syscall, wait_start - st->released_at);
+   }
+
+   st->released_for_syscall = False;
+   st->acquired_at          = now;
+   st->slice_fastmiss       = 0;
+}
+
+/* Called with the_BigLock still held by tid, just before releasing
+   it. */
+static void sched_stats_releasing ( ThreadId tid, ThreadStatus sleepstate )
+{
+   SchedStats* st  = &sched_stats[tid];
+   ULong       now = VG_(read_microsecond_timer)();
+
+   st->run_us += now - st->acquired_at;
+   sched_hist_add(st->hist_timeslice, now - st->acquired_at);
+   sched_hist_add(st->hist_fastmiss, st->slice_fastmiss);
+
+   if (sleepstate == VgTs_WaitSys)
+      st->n_syscalls++;
+   else
+      st->n_yields++;
+
+   st->released_at          = now;
+   st->released_for_syscall = sleepstate == VgTs_WaitSys;
+}
+
+static void print_sched_hist ( ThreadId tid, const HChar* name,
+                               const UInt* hist, Bool csv )
+{
+   UInt b;
+
+   if (!csv)
+      VG_(printf)("   %-16s:", name);
+   for (b = 0; b < N_SCHED_HIST; b++) {
+      ULong lo = b == 0 ? 0 : 1ULL << (b-1);
+      ULong hi = 1ULL << b;
+      if (hist[b] == 0)
+         continue;
+      if (csv)
+         VG_(printf)("%u,%s,%llu,%llu,%u\n", tid, name, lo, hi, hist[b]);
+      else
+         VG_(printf)(" %llu..:%u", lo, hist[b]);
+   }
+   if (!csv)
+      VG_(printf)("\n");
+}
+
+void VG_(print_sched_thread_stats) ( Bool csv )
+{
+   ThreadId tid;
+
+   if (sched_stats == NULL)
+      return;
+
+   if (csv)
+      VG_(printf)("tid,acquires,lock_wait_us,run_us,syscall_us,syscalls,"
+                  "involuntary_yields,voluntary_yields,fastmiss\n");
+   for (tid = 1; tid < VG_N_THREADS; tid++) {
+      const SchedStats* st = &sched_stats[tid];
+      if (st->n_acquires == 0)
+         continue;
+      if (csv)
+         VG_(printf)("%u,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                     tid, st->n_acquires, st->lock_wait_us, st->run_us,
+                     st->syscall_us, st->n_syscalls, st->n_involuntary,
+                     st->n_yields - st->n_involuntary, st->n_fastmiss);
+      else
+         VG_(printf)("tid %u: %'llu lock acquisitions, waited %'llu us,"
+                     " ran %'llu us, %'llu us in %'llu syscalls\n"
+                     "   %'llu involuntary and %'llu voluntary yields,"
+                     " %'llu fast-cache misses\n",
+                     tid, st->n_acquires, st->lock_wait_us, st->run_us,
+                     st->syscall_us, st->n_syscalls, st->n_involuntary,
+                     st->n_yields - st->n_involuntary, st->n_fastmiss);
+   }
+
+   if (csv)
+      VG_(printf)("\ntid,histogram,lo,hi,count\n");
+   for (tid = 1; tid < VG_N_THREADS; tid++) {
+      const SchedStats* st = &sched_stats[tid];
+      if (st->n_acquires == 0)
+         continue;
+      if (!csv)
+         VG_(printf)("tid %u histograms (bucket lower bound:count):\n", tid);
+      print_sched_hist(tid, "lock_wait_us", st->hist_lock_wait, csv);
+      print_sched_hist(tid, "timeslice_us", st->hist_timeslice, csv);
+      print_sched_hist(tid, "syscall_us",   st->hist_syscall,   csv);
+      print_sched_hist(tid, "slice_fastmiss", st->hist_fastmiss, csv);
+   }
+}
+
 void VG_(print_scheduler_stats)(void)
 {
    VG_(message)(Vg_DebugMsg,
@@ -160,6 +310,7 @@ void VG_(print_scheduler_stats)(void)
    VG_(message)(Vg_DebugMsg, 
                 "   sanity: %u cheap, %u expensive checks.\n",
                 sanity_fast_count, sanity_slow_count );
+   VG_(print_sched_thread_stats)(False);
 }
 
 /*
@@ -245,6 +396,8 @@ ThreadId VG_(alloc_ThreadState) ( void )
          if (VG_(threads)[i].thread_name)
             VG_(free)(VG_(threads)[i].thread_name);
          VG_(threads)[i].thread_name = NULL;
+         if (sched_stats != NULL)
+            VG_(memset)(&sched_stats[i], 0, sizeof(sched_stats[i]));
          return i;
       }
    }
@@ -265,6 +418,7 @@ ThreadId VG_(alloc_ThreadState) ( void )
 void VG_(acquire_BigLock)(ThreadId tid, const HChar* who)
 {
    ThreadState *tst;
+   ULong wait_start = 0;
 
 #if 0
    if (VG_(clo_trace_sched)) {
@@ -276,9 +430,15 @@ void VG_(acquire_BigLock)(ThreadId tid, const HChar* who)
 
    /* First, acquire the_BigLock.  We can't do anything else safely
       prior to this point.  Even doing debug printing prior to this
-      point is, technically, wrong. */
+      point is, technically, wrong.  Reading the clock is fine. */
+   if (UNLIKELY(sched_stats != NULL))
+      wait_start = VG_(read_microsecond_timer)();
+
    VG_(acquire_BigLock_LL)(NULL);
 
+   if (UNLIKELY(sched_stats != NULL))
+      sched_stats_acquired(tid, wait_start);
+
    tst = VG_(get_ThreadState)(tid);
 
    vg_assert(tst->status != VgTs_Runnable);
@@ -333,6 +493,9 @@ void VG_(release_BigLock)(ThreadId tid, ThreadStatus sleepstate,
       print_sched_event(tid, buf);
    }
 
+   if (UNLIKELY(sched_stats != NULL))
+      sched_stats_releasing(tid, sleepstate);
+
    /* Release the_BigLock; this will reschedule any runnable
       thread. */
    VG_(release_BigLock_LL)(NULL);
@@ -608,7 +771,13 @@ ThreadId VG_(scheduler_init_phase1) ( void )
 
    VG_(debugLog)(1,"sched","sched_init_phase1\n");
 
-   if (VG_(clo_fair_sched) != disable_fair_sched
+   if (VG_(clo_fair_sched) == queue_fair_sched) {
+      if (!ML_(set_sched_lock_impl)(sched_lock_queue)) {
+         VG_(printf)("Error: the queue scheduler lock is not supported"
+                     " on this system.\n");
+         VG_(exit)(1);
+      }
+   } else if (VG_(clo_fair_sched) != disable_fair_sched
        && !ML_(set_sched_lock_impl)(sched_lock_ticket)
        && VG_(clo_fair_sched) == enable_fair_sched)
    {
@@ -624,6 +793,15 @@ ThreadId VG_(scheduler_init_phase1) ( void )
 
    init_BigLock();
 
+   if (VG_(clo_sched_stats)) {
+      sched_stats = VG_(calloc)("sched.stats", VG_N_THREADS,
+                                sizeof(SchedStats));
+      /* Establish the timer base now, while there is only one
+         thread: VG_(acquire_BigLock) reads it before taking the
+         lock. */
+      (void)VG_(read_microsecond_timer)();
+   }
+
    for (i = 0 /* NB; not 1 */; i < VG_N_THREADS; i++) {
       /* Paranoia .. completely zero it out. */
       VG_(memset)( & VG_(threads)[i], 0, sizeof( VG_(threads)[i] ) );
@@ -1039,6 +1217,11 @@ static void handle_tt_miss ( ThreadId tid )
    Bool found;
    Addr ip = VG_(get_IP)(tid);
 
+   if (UNLIKELY(sched_stats != NULL)) {
+      sched_stats[tid].n_fastmiss++;
+      sched_stats[tid].slice_fastmiss++;
+   }
+
    /* Trivial event.  Miss in the fast-cache.  Do a full
       lookup for it. */
    found = VG_(search_transtab)( NULL, NULL, NULL,
@@ -1296,12 +1479,21 @@ VgSchedReturnCode VG_(scheduler) ( ThreadId tid )
 	 /* 3 Aug 06: doing sys__nsleep works but crashes some apps.
             sys_yield also helps the problem, whilst not crashing apps. */
 
-	 VG_(release_BigLock)(tid, VgTs_Yielding, 
-                                   "VG_(scheduler):timeslice");
-	 /* ------------ now we don't have The Lock ------------ */
-
-	 VG_(acquire_BigLock)(tid, "VG_(scheduler):timeslice");
-	 /* ------------ now we do have The Lock ------------ */
+	 /* If this is the only living thread there is nobody to hand
+	    the CPU to, and the release/re-acquire round trip (a pipe
+	    write and read with the generic lock) buys nothing.  Any
+	    thread created later can only appear via a syscall made by
+	    this one, which releases the lock anyway. */
+	 if (VG_(count_living_threads)() > 1) {
+	    if (UNLIKELY(sched_stats != NULL))
+	       sched_stats[tid].n_involuntary++;
+	    VG_(release_BigLock)(tid, VgTs_Yielding, 
+                                      "VG_(scheduler):timeslice");
+	    /* ------------ now we don't have The Lock ------------ */
+
+	    VG_(acquire_BigLock)(tid, "VG_(scheduler):timeslice");
+	    /* ------------ now we do have The Lock ------------ */
+	 }
 
 	 /* OK, do some relatively expensive housekeeping stuff */
 	 scheduler_sanity(tid);
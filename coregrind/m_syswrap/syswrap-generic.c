@@ -4091,7 +4091,9 @@ PRE(sys_poll)
    */
    UInt i;
    struct vki_pollfd* ufds = (struct vki_pollfd *)ARG1;
-   *flags |= SfMayBlock;
+   /* With a zero timeout poll cannot block. */
+   if ((Int)ARG3 != 0)
+      *flags |= SfMayBlock;
    PRINT("sys_poll ( %#lx, %lu, %ld )\n", ARG1, ARG2, SARG3);
    PRE_REG_READ3(long, "poll",
                  struct vki_pollfd *, ufds, unsigned int, nfds, long, timeout);
@@ -1191,7 +1191,20 @@ PRE(sys_futex)
       break;
    }
 
-   *flags |= SfMayBlock;
+   /* The wake and requeue operations never put the caller to sleep.
+      They are very frequent in threaded programs, so do them without
+      the overhead of releasing and reacquiring the BigLock. */
+   switch(ARG2 & ~(VKI_FUTEX_PRIVATE_FLAG|VKI_FUTEX_CLOCK_REALTIME)) {
+   case VKI_FUTEX_WAKE:
+   case VKI_FUTEX_WAKE_BITSET:
+   case VKI_FUTEX_WAKE_OP:
+   case VKI_FUTEX_REQUEUE:
+   case VKI_FUTEX_CMP_REQUEUE:
+      break;
+   default:
+      *flags |= SfMayBlock;
+      break;
+   }
 
    switch(ARG2 & ~(VKI_FUTEX_PRIVATE_FLAG|VKI_FUTEX_CLOCK_REALTIME)) {
    case VKI_FUTEX_WAIT:
@@ -1444,7 +1457,10 @@ PRE(sys_epoll_ctl)
 
 PRE(sys_epoll_wait)
 {
-   *flags |= SfMayBlock;
+   /* A zero timeout makes epoll_wait only poll, so it can be done
+      without releasing the BigLock. */
+   if ((Int)ARG4 != 0)
+      *flags |= SfMayBlock;
    PRINT("sys_epoll_wait ( %ld, %#lx, %ld, %ld )", SARG1, ARG2, SARG3, SARG4);
    PRE_REG_READ4(long, "epoll_wait",
                  int, epfd, struct vki_epoll_event *, events,
@@ -1691,6 +1691,115 @@ Bool VG_(is_in_syscall) ( Int tid )
    return (syscallInfo[tid].status.what != SsIdle);
 }
 
+/* Per-syscall statistics, shown by --stats=yes.  These are always
+   counted; the times (in microseconds) are only measured with
+   --stats=yes since reading the timer is itself a syscall.  'usecs'
+   covers the whole of VG_(client_syscall), 'usecs_kernel' only the
+   syscall proper, so the difference is what the wrappers, the signal
+   mask handling and (for async syscalls) the BigLock round trip cost.
+   The table is only ever accessed with the BigLock held. */
+#define N_SYSCALL_STATS 512
+
+typedef
+   struct {
+      Word  sysno;           // -1 if the entry is unused
+      ULong n_calls;
+      ULong n_pre_completed; // completed or failed by the pre-handler
+      ULong n_sync;          // done directly, keeping the BigLock
+      ULong n_async;         // done after releasing the BigLock
+      ULong usecs;
+      ULong usecs_kernel;
+   }
+   SyscallStats;
+
+static SyscallStats syscall_stats[N_SYSCALL_STATS];
+static ULong n_syscall_stats_dropped = 0;
+
+static SyscallStats* get_syscall_stats ( Word sysno )
+{
+   UInt i, h;
+
+   h = (UWord)sysno % N_SYSCALL_STATS;
+   for (i = 0; i < N_SYSCALL_STATS; i++) {
+      SyscallStats* st = &syscall_stats[(h + i) % N_SYSCALL_STATS];
+      if (st->sysno == sysno)
+         return st;
+      if (st->sysno == -1) {
+         st->sysno = sysno;
+         return st;
+      }
+   }
+   n_syscall_stats_dropped++;
+   return NULL;
+}
+
+static Int cmp_SyscallStats_by_cost ( const void* v1, const void* v2 )
+{
+   const SyscallStats* st1 = v1;
+   const SyscallStats* st2 = v2;
+   /* Decreasing total time, then decreasing number of calls. */
+   if (st1->usecs != st2->usecs)
+      return st1->usecs > st2->usecs ? -1 : 1;
+   if (st1->n_calls != st2->n_calls)
+      return st1->n_calls > st2->n_calls ? -1 : 1;
+   return 0;
+}
+
+void VG_(print_syscall_stats) ( void )
+{
+   const Int     n_to_show = 20;
+   SyscallStats* sorted;
+   Int           i, n_used;
+   ULong         n_calls = 0, n_pre = 0, n_sync = 0, n_async = 0;
+
+   n_used = 0;
+   for (i = 0; i < N_SYSCALL_STATS; i++) {
+      if (syscall_stats[i].n_calls == 0)
+         continue;
+      n_used++;
+      n_calls += syscall_stats[i].n_calls;
+      n_pre   += syscall_stats[i].n_pre_completed;
+      n_sync  += syscall_stats[i].n_sync;
+      n_async += syscall_stats[i].n_async;
+   }
+   VG_(message)(Vg_DebugMsg,
+                "syscalls: %'llu calls: %'llu done by the pre-handler, "
+                "%'llu sync, %'llu async\n",
+                n_calls, n_pre, n_sync, n_async);
+   if (n_syscall_stats_dropped > 0)
+      VG_(message)(Vg_DebugMsg,
+                   "syscalls: %'llu calls not recorded per syscall\n",
+                   n_syscall_stats_dropped);
+   if (n_used == 0)
+      return;
+
+   sorted = VG_(malloc)("syswrap.print_syscall_stats",
+                        n_used * sizeof(SyscallStats));
+   n_used = 0;
+   for (i = 0; i < N_SYSCALL_STATS; i++)
+      if (syscall_stats[i].n_calls > 0)
+         sorted[n_used++] = syscall_stats[i];
+   VG_(ssort)(sorted, n_used, sizeof(SyscallStats), cmp_SyscallStats_by_cost);
+
+   for (i = 0; i < n_used && i < n_to_show; i++) {
+      const SyscallStats* st = &sorted[i];
+      if (VG_(clo_stats))
+         VG_(message)(Vg_DebugMsg,
+                      "   syscall %-12s %'12llu calls (%'llu sync, "
+                      "%'llu async), %'llu us, %'llu us in kernel\n",
+                      VG_SYSNUM_STRING(st->sysno), st->n_calls,
+                      st->n_sync, st->n_async,
+                      st->usecs, st->usecs_kernel);
+      else
+         VG_(message)(Vg_DebugMsg,
+                      "   syscall %-12s %'12llu calls (%'llu sync, "
+                      "%'llu async)\n",
+                      VG_SYSNUM_STRING(st->sysno), st->n_calls,
+                      st->n_sync, st->n_async);
+   }
+   VG_(free)(sorted);
+}
+
 static void ensure_initialised ( void )
 {
    Int i;
@@ -1704,6 +1813,10 @@ static void ensure_initialised ( void )
    for (i = 0; i < VG_N_THREADS; i++) {
       VG_(clear_syscallInfo)( i );
    }
+
+   for (i = 0; i < N_SYSCALL_STATS; i++) {
+      syscall_stats[i].sysno = -1;
+   }
 }
 
 /* --- This is the main function of this file. --- */
@@ -1715,9 +1828,14 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
    const SyscallTableEntry* ent;
    SyscallArgLayout         layout;
    SyscallInfo*             sci;
+   SyscallStats*            st;
+   ULong                    t_start = 0, t_kernel = 0, t_kernel_start = 0;
 
    ensure_initialised();
 
+   if (UNLIKELY(VG_(clo_stats)))
+      t_start = VG_(read_microsecond_timer)();
+
    vg_assert(VG_(is_valid_tid)(tid));
    vg_assert(tid >= 1 && tid < VG_N_THREADS);
    vg_assert(VG_(is_running_thread)(tid));
@@ -1923,6 +2041,17 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
              || sci->status.what == SsComplete);
    vg_assert(sci->args.sysno == sci->orig_args.sysno);
 
+   st = get_syscall_stats(sysno);
+   if (st) {
+      st->n_calls++;
+      if (sci->status.what == SsComplete)
+         st->n_pre_completed++;
+      else if (sci->flags & SfMayBlock)
+         st->n_async++;
+      else
+         st->n_sync++;
+   }
+
    if (sci->status.what == SsComplete && !sr_isError(sci->status.sres)) {
       /* The pre-handler completed the syscall itself, declaring
          success. */
@@ -2004,7 +2133,11 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
 
          /* Do the call, which operates directly on the guest state,
             not on our abstracted copies of the args/result. */
+         if (UNLIKELY(VG_(clo_stats)))
+            t_kernel_start = VG_(read_microsecond_timer)();
          do_syscall_for_client(sysno, tst, &mask);
+         if (UNLIKELY(VG_(clo_stats)))
+            t_kernel = VG_(read_microsecond_timer)() - t_kernel_start;
 
          /* do_syscall_for_client may not return if the syscall was
             interrupted by a signal.  In that case, flow of control is
@@ -2044,11 +2177,15 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
             kernel, there's no point in flushing them back to the
             guest state.  Indeed doing so could be construed as
             incorrect. */
-         SysRes sres 
-            = VG_(do_syscall)(sysno, sci->args.arg1, sci->args.arg2, 
-                                     sci->args.arg3, sci->args.arg4, 
-                                     sci->args.arg5, sci->args.arg6,
-                                     sci->args.arg7, sci->args.arg8 );
+         SysRes sres;
+         if (UNLIKELY(VG_(clo_stats)))
+            t_kernel_start = VG_(read_microsecond_timer)();
+         sres = VG_(do_syscall)(sysno, sci->args.arg1, sci->args.arg2, 
+                                       sci->args.arg3, sci->args.arg4, 
+                                       sci->args.arg5, sci->args.arg6,
+                                       sci->args.arg7, sci->args.arg8 );
+         if (UNLIKELY(VG_(clo_stats)))
+            t_kernel = VG_(read_microsecond_timer)() - t_kernel_start;
          sci->status = convert_SysRes_to_SyscallStatus(sres);
 
          /* Be decorative, if required. */
@@ -2080,6 +2217,11 @@ void VG_(client_syscall) ( ThreadId tid, UInt trc )
    PRINT(" ");
    VG_(post_syscall)(tid);
    PRINT("\n");
+
+   if (UNLIKELY(VG_(clo_stats)) && st) {
+      st->usecs        += VG_(read_microsecond_timer)() - t_start;
+      st->usecs_kernel += t_kernel;
+   }
 }
 
 
@@ -44,6 +44,7 @@
 #include "pub_core_mallocfree.h" // VG_(out_of_memory_NORETURN)
 #include "pub_core_xarray.h"
 #include "pub_core_dispatch.h"   // For VG_(disp_cp*) addresses
+#include "pub_core_threadstate.h" // VG_(running_tid), VG_N_THREADS
 
 
 #define DEBUG_TRANSTAB 0
@@ -424,6 +425,12 @@ typedef
          in strictly non-overlapping order, so we can binary search
          them at any time. */
       XArray* host_extents; /* XArray* of HostExtent */
+
+      /* Set whenever a full lookup finds a translation in this
+         sector, and cleared when the sector is passed over for
+         recycling, so that sectors still in use get a second chance
+         (see pick_sector_to_recycle). */
+      Bool referenced;
    }
    Sector;
 
@@ -482,6 +489,48 @@ typedef
 /*global*/ __attribute__((aligned(16)))
            FastCacheEntry VG_(tt_fast)[VG_TT_FAST_SIZE];
 
+/* Per-thread second-level fast caches.  VG_(tt_fast) is shared by
+   all threads, so threads running unrelated code keep evicting each
+   other's entries, and after a context switch the incoming thread
+   takes a round of fast-cache misses, each of which costs a full
+   VG_(search_transtab) over the sectors.  Each thread therefore keeps
+   a small direct-mapped cache of its own, consulted on a VG_(tt_fast)
+   miss before the sectors are searched.  It is indexed by a different
+   hash from VG_(tt_fast) so that the two don't conflict on the same
+   addresses.
+
+   Rather than flushing every thread's cache whenever VG_(tt_fast) is
+   invalidated, invalidateFastCache just bumps tt_fast_epoch, and a
+   thread cache with an older epoch is cleared on its next use.
+   Caches are allocated on first use and kept for the lifetime of the
+   tid slot; a new thread reusing the slot inherits entries which are
+   still valid translations, so that is harmless. */
+#define N_TT_FAST_THREAD_BITS 11
+#define N_TT_FAST_THREAD      (1 << N_TT_FAST_THREAD_BITS)
+#define TT_FAST_THREAD_MASK   (N_TT_FAST_THREAD - 1)
+
+typedef
+   struct {
+      ULong          epoch;
+      FastCacheEntry entry[N_TT_FAST_THREAD];
+   }
+   ThreadFastCache;
+
+static ThreadFastCache** tt_fast_thread = NULL; /* [VG_N_THREADS] */
+static ULong tt_fast_epoch = 1;
+
+/* The most recently added translation.  Every transtab miss that
+   leads to a translation is immediately followed by a lookup of the
+   block just made (see handle_tt_miss and handle_chain_me in
+   m_scheduler), and that lookup would otherwise have to walk the
+   sectors in sector_search_order[], which on startup-heavy programs
+   rarely has the youngest sector at the front.  The entry is only a
+   hint: it is validated against the sector contents before use, so
+   recycling or discarding does not need to keep it up to date. */
+static Addr  last_added_entry = TRANSTAB_BOGUS_GUEST_ADDR;
+static SECno last_added_sNo   = INV_SNO;
+static TTEno last_added_tteNo = INV_TTE;
+
 /* Make sure we're not used before initialisation. */
 static Bool init_done = False;
 
@@ -492,9 +541,16 @@ static Bool init_done = False;
 static ULong n_fast_flushes = 0;
 static ULong n_fast_updates = 0;
 
-/* Number of full lookups done. */
+/* Number of full lookups done, and how many of those were satisfied
+   by the most recently added translation without any probing. */
 static ULong n_full_lookups = 0;
 static ULong n_lookup_probes = 0;
+static ULong n_lookup_last_added = 0;
+
+/* Number of lookups satisfied by a per-thread fast cache, and the
+   number of per-thread fast cache flushes. */
+static ULong n_thread_fast_hits    = 0;
+static ULong n_thread_fast_flushes = 0;
 
 /* Number/osize/tsize of translations entered; also the number of
    those for which self-checking was requested. */
@@ -507,6 +563,7 @@ static ULong n_in_sc_count = 0;
 static ULong n_dump_count = 0;
 static ULong n_dump_osize = 0;
 static ULong n_sectors_recycled = 0;
+static ULong n_sectors_spared   = 0;
 
 /* Number/osize of translations discarded due to requests to do so. */
 static ULong n_disc_count = 0;
@@ -907,6 +964,12 @@ void VG_(tt_tc_do_chaining) ( void* from__patch_addr,
 
    TTEntryC* from_tteC = index_tteC(from_sNo, from_tteNo);
 
+   /* Once chained, the to_ block is run without being looked up, so
+      this is the last chance to note that both sectors are in use
+      (see pick_sector_to_recycle). */
+   sectors[from_sNo].referenced = True;
+   sectors[to_sNo].referenced   = True;
+
    /* Get VEX to do the patching itself.  We have to hand it off
       since it is host-dependent. */
    VexInvalRange vir
@@ -1483,6 +1546,51 @@ static void invalidateFastCache ( void )
 
    vg_assert(j == VG_TT_FAST_SIZE);
    n_fast_flushes++;
+
+   /* and, lazily, all the per-thread ones */
+   tt_fast_epoch++;
+}
+
+static inline UInt HASH_TT_FAST_THREAD ( Addr key )
+{
+   UWord k = (UWord)key;
+   return (UInt)((k ^ (k >> N_TT_FAST_THREAD_BITS)) & TT_FAST_THREAD_MASK);
+}
+
+/* Returns the fast cache of the running thread, up to date with
+   respect to tt_fast_epoch, or NULL if no thread is running. */
+static ThreadFastCache* getThreadFastCache ( void )
+{
+   ThreadId tid = VG_(running_tid);
+   ThreadFastCache* tfc;
+   UInt i;
+
+   if (tid == VG_INVALID_THREADID || tid >= VG_N_THREADS)
+      return NULL;
+
+   if (UNLIKELY(tt_fast_thread == NULL)) {
+      tt_fast_thread = ttaux_malloc("transtab.tt_fast_thread.1",
+                                    VG_N_THREADS * sizeof(ThreadFastCache*));
+      for (i = 0; i < VG_N_THREADS; i++)
+         tt_fast_thread[i] = NULL;
+   }
+
+   tfc = tt_fast_thread[tid];
+   if (UNLIKELY(tfc == NULL)) {
+      tfc = ttaux_malloc("transtab.tt_fast_thread.2", sizeof(ThreadFastCache));
+      tfc->epoch = 0;
+      tt_fast_thread[tid] = tfc;
+   }
+
+   if (UNLIKELY(tfc->epoch != tt_fast_epoch)) {
+      for (i = 0; i < N_TT_FAST_THREAD; i++) {
+         tfc->entry[i].guest = TRANSTAB_BOGUS_GUEST_ADDR;
+         tfc->entry[i].host  = 0;
+      }
+      tfc->epoch = tt_fast_epoch;
+      n_thread_fast_flushes++;
+   }
+   return tfc;
 }
 
 
@@ -1534,7 +1642,7 @@ static void initialiseSector ( SECno sno )
       if (VG_(clo_stats) || VG_(debugLog_getLevel)() >= 1)
          VG_(dmsg)("transtab: " "allocate sector %d\n", sno);
 
-      sres = VG_(am_mmap_anon_float_valgrind)( 8 * tc_sector_szQ );
+      sres = VG_(am_mmap_anon_float_valgrind_huge)( 8 * tc_sector_szQ );
       if (sr_isError(sres)) {
          VG_(out_of_memory_NORETURN)("initialiseSector(TC)", 
                                      8 * tc_sector_szQ );
@@ -1542,7 +1650,7 @@ static void initialiseSector ( SECno sno )
       }
       sec->tc = (ULong*)(Addr)sr_Res(sres);
 
-      sres = VG_(am_mmap_anon_float_valgrind)
+      sres = VG_(am_mmap_anon_float_valgrind_huge)
                 ( N_TTES_PER_SECTOR * sizeof(TTEntryC) );
       if (sr_isError(sres)) {
          VG_(out_of_memory_NORETURN)("initialiseSector(TTC)", 
@@ -1551,7 +1659,7 @@ static void initialiseSector ( SECno sno )
       }
       sec->ttC = (TTEntryC*)(Addr)sr_Res(sres);
 
-      sres = VG_(am_mmap_anon_float_valgrind)
+      sres = VG_(am_mmap_anon_float_valgrind_huge)
                 ( N_TTES_PER_SECTOR * sizeof(TTEntryH) );
       if (sr_isError(sres)) {
          VG_(out_of_memory_NORETURN)("initialiseSector(TTH)", 
@@ -1567,7 +1675,7 @@ static void initialiseSector ( SECno sno )
          add_to_empty_tt_list(sno, ei);
       }
 
-      sres = VG_(am_mmap_anon_float_valgrind)
+      sres = VG_(am_mmap_anon_float_valgrind_huge)
                 ( N_HTTES_PER_SECTOR * sizeof(TTEno) );
       if (sr_isError(sres)) {
          VG_(out_of_memory_NORETURN)("initialiseSector(HTT)", 
@@ -1678,6 +1786,7 @@ static void initialiseSector ( SECno sno )
 
    sec->tc_next = sec->tc;
    sec->tt_n_inuse = 0;
+   sec->referenced = False;
 
    invalidateFastCache();
 
@@ -1686,6 +1795,45 @@ static void initialiseSector ( SECno sno )
    }
 }
 
+/* Choose the sector to use once sector y is full.  Sectors are taken
+   round-robin, which fills never-used sectors first, but once they
+   have all been used a sector that has been referenced since the clock
+   hand last passed it is spared once (and its reference cleared), so
+   that sectors holding recently used translations are not thrown away
+   only to have their contents retranslated straight afterwards.  If
+   every sector was referenced, this degenerates to plain round-robin.
+
+   A sector is marked as referenced when VG_(search_transtab) finds a
+   translation in it, i.e. on a miss in the fast caches, or when
+   VG_(tt_tc_do_chaining) links a block into or out of it.  Executions
+   served by VG_(tt_fast), by the per-thread caches or through
+   existing chains are not seen, so a sector whose hot code is all
+   chained or cached can still look unreferenced. */
+static SECno pick_sector_to_recycle ( SECno y )
+{
+   SECno sno = y;
+   UInt  i;
+
+   for (i = 0; i < n_sectors; i++) {
+      sno++;
+      if (sno >= n_sectors)
+         sno = 0;
+      if (sno == y)
+         continue;
+      if (sectors[sno].tc == NULL || !sectors[sno].referenced)
+         return sno;
+      sectors[sno].referenced = False;
+      n_sectors_spared++;
+      if (VG_(clo_stats) || VG_(debugLog_getLevel)() >= 1)
+         VG_(dmsg)("transtab: " "spare    sector %d\n", sno);
+   }
+
+   sno = y + 1;
+   if (sno >= n_sectors)
+      sno = 0;
+   return sno;
+}
+
 /* Add a translation of vge to TT/TC.  The translation is temporarily
    in code[0 .. code_len-1].
 
@@ -1757,9 +1905,7 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
                    y, tt_loading_pct, tc_loading_pct,
                    8 * (tc_sector_szQ - tcAvailQ)/sectors[y].tt_n_inuse);
       }
-      youngest_sector++;
-      if (youngest_sector >= n_sectors)
-         youngest_sector = 0;
+      youngest_sector = pick_sector_to_recycle(y);
       y = youngest_sector;
       initialiseSector(y);
    }
@@ -1857,6 +2003,10 @@ void VG_(add_to_transtab)( const VexGuestExtents* vge,
 
    /* Note the eclass numbers for this translation. */
    upd_eclasses_after_add( &sectors[y], tteix );
+
+   last_added_entry = entry;
+   last_added_sNo   = y;
+   last_added_tteNo = tteix;
 }
 
 
@@ -1873,11 +2023,62 @@ Bool VG_(search_transtab) ( /*OUT*/Addr*  res_hcode,
    SECno i, sno;
    HTTno j, k, kstart;
    TTEno tti;
+   ThreadFastCache* tfc;
 
    vg_assert(init_done);
+
+   /* The per-thread cache only knows host addresses, so it can't
+      help callers that want the sector and TT entry. */
+   tfc = NULL;
+   if (res_sNo == NULL && res_tteNo == NULL
+       && guest_addr != TRANSTAB_BOGUS_GUEST_ADDR) {
+      tfc = getThreadFastCache();
+      if (tfc != NULL) {
+         UInt cno = HASH_TT_FAST_THREAD(guest_addr);
+         if (tfc->entry[cno].guest == guest_addr) {
+            n_thread_fast_hits++;
+            if (upd_cache)
+               setFastCacheEntry( guest_addr,
+                                  (ULong*)tfc->entry[cno].host );
+            if (res_hcode)
+               *res_hcode = tfc->entry[cno].host;
+            return True;
+         }
+      }
+   }
+
+   n_full_lookups++;
+
+   /* Is it the translation we have just made?  The hint can be stale,
+      so check the slot is still in use for guest_addr. */
+   if (guest_addr == last_added_entry
+       && isValidSector(last_added_sNo)
+       && sectors[last_added_sNo].tc != NULL
+       && last_added_tteNo < N_TTES_PER_SECTOR
+       && sectors[last_added_sNo].ttH[last_added_tteNo].status == InUse
+       && sectors[last_added_sNo].ttC[last_added_tteNo].entry == guest_addr) {
+      tti = last_added_tteNo;
+      sno = last_added_sNo;
+      n_lookup_last_added++;
+      sectors[sno].referenced = True;
+      if (tfc != NULL) {
+         UInt cno = HASH_TT_FAST_THREAD(guest_addr);
+         tfc->entry[cno].guest = guest_addr;
+         tfc->entry[cno].host  = (Addr)sectors[sno].ttC[tti].tcptr;
+      }
+      if (upd_cache)
+         setFastCacheEntry( guest_addr, sectors[sno].ttC[tti].tcptr );
+      if (res_hcode)
+         *res_hcode = (Addr)sectors[sno].ttC[tti].tcptr;
+      if (res_sNo)
+         *res_sNo = sno;
+      if (res_tteNo)
+         *res_tteNo = tti;
+      return True;
+   }
+
    /* Find the initial probe point just once.  It will be the same in
       all sectors and avoids multiple expensive % operations. */
-   n_full_lookups++;
    kstart = HASH_TT(guest_addr);
    vg_assert(kstart >= 0 && kstart < N_HTTES_PER_SECTOR);
 
@@ -1896,6 +2097,12 @@ Bool VG_(search_transtab) ( /*OUT*/Addr*  res_hcode,
          if (tti < N_TTES_PER_SECTOR
              && sectors[sno].ttC[tti].entry == guest_addr) {
             /* found it */
+            sectors[sno].referenced = True;
+            if (tfc != NULL) {
+               UInt cno = HASH_TT_FAST_THREAD(guest_addr);
+               tfc->entry[cno].guest = guest_addr;
+               tfc->entry[cno].host  = (Addr)sectors[sno].ttC[tti].tcptr;
+            }
             if (upd_cache)
                setFastCacheEntry( 
                   guest_addr, sectors[sno].ttC[tti].tcptr );
@@ -2568,11 +2775,15 @@ UInt VG_(get_bbs_translated) ( void )
 void VG_(print_tt_tc_stats) ( void )
 {
    VG_(message)(Vg_DebugMsg,
-      "    tt/tc: %'llu tt lookups requiring %'llu probes\n",
-      n_full_lookups, n_lookup_probes );
+      "    tt/tc: %'llu tt lookups requiring %'llu probes"
+      " (%'llu most recently added)\n",
+      n_full_lookups, n_lookup_probes, n_lookup_last_added );
    VG_(message)(Vg_DebugMsg,
       "    tt/tc: %'llu fast-cache updates, %'llu flushes\n",
       n_fast_updates, n_fast_flushes );
+   VG_(message)(Vg_DebugMsg,
+      "    tt/tc: %'llu per-thread fast-cache hits, %'llu flushes\n",
+      n_thread_fast_hits, n_thread_fast_flushes );
 
    VG_(message)(Vg_DebugMsg,
                 " transtab: new        %'llu "
@@ -2584,8 +2795,9 @@ void VG_(print_tt_tc_stats) ( void )
                 n_in_tsize / (n_in_count ? n_in_count : 1));
    VG_(message)(Vg_DebugMsg,
                 " transtab: dumped     %'llu (%'llu -> ?" "?) "
-                "(sectors recycled %'llu)\n",
-                n_dump_count, n_dump_osize, n_sectors_recycled );
+                "(sectors recycled %'llu, spared %'llu)\n",
+                n_dump_count, n_dump_osize, n_sectors_recycled,
+                n_sectors_spared );
    VG_(message)(Vg_DebugMsg,
                 " transtab: discarded  %'llu (%'llu -> ?" "?)\n",
                 n_disc_count, n_disc_osize );
@@ -242,6 +242,11 @@ extern SysRes VG_(am_mmap_anon_float_client) ( SizeT length, Int prot );
    itself more address space when needed. */
 extern SysRes VG_(am_mmap_anon_float_valgrind)( SizeT cszB );
 
+/* As VG_(am_mmap_anon_float_valgrind), but with --huge-pages=yes align
+   the mapping and ask the kernel to back it with transparent huge
+   pages.  Falls back to normal pages if these are not available. */
+extern SysRes VG_(am_mmap_anon_float_valgrind_huge)( SizeT cszB );
+
 /* Map privately a file at an unconstrained address for V, and update the
    segment array accordingly.  This is used by V for transiently
    mapping in object files to read their debug info.  */
@@ -190,10 +190,18 @@ extern Bool  VG_(clo_debug_dump_frames);
 /* DEBUG: print redirection details?  default: NO */
 extern Bool  VG_(clo_trace_redir);
 /* Enable fair scheduling on multicore systems? default: NO */
-enum FairSchedType { disable_fair_sched, enable_fair_sched, try_fair_sched };
+enum FairSchedType { disable_fair_sched, enable_fair_sched, try_fair_sched,
+                     queue_fair_sched };
 extern enum FairSchedType VG_(clo_fair_sched);
+/* With --fair-sched=queue, which waiter gets the lock on release.
+   default: FIFO */
+enum SchedHandoffType { fifo_sched_handoff, node_sched_handoff,
+                        cpu_sched_handoff };
+extern enum SchedHandoffType VG_(clo_fair_sched_handoff);
 /* DEBUG: print thread scheduling events?  default: NO */
 extern Bool  VG_(clo_trace_sched);
+/* DEBUG: record per-thread scheduling latency histograms?  default: NO */
+extern Bool  VG_(clo_sched_stats);
 /* DEBUG: do heap profiling?  default: NO */
 extern Bool  VG_(clo_profile_heap);
 #define MAX_REDZONE_SZB 128
@@ -318,6 +326,10 @@ extern UInt VG_(clo_num_transtab_sectors);
    provided default. */
 extern UInt VG_(clo_avg_transtab_entry_size);
 
+/* Ask the kernel to back the translated code cache and the tools'
+   shadow memory with transparent huge pages?  Default: NO */
+extern Bool VG_(clo_huge_pages);
+
 /* Only client requested fixed mapping can be done below 
    VG_(clo_aspacem_minAddr). */
 extern Addr VG_(clo_aspacem_minAddr);
@@ -110,6 +110,10 @@ extern void VG_(force_vgdb_poll) ( void );
 /* Stats ... */
 extern void VG_(print_scheduler_stats) ( void );
 
+/* Per-thread scheduling latency stats and histograms, as text or CSV.
+   Prints nothing unless --sched-stats=yes. */
+extern void VG_(print_sched_thread_stats) ( Bool csv );
+
 /* If False, a fault is Valgrind-internal (ie, a bug) */
 extern Bool VG_(in_generated_code);
 
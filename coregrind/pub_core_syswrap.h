@@ -54,6 +54,9 @@ extern void VG_(clear_syscallInfo) ( Int tid );
 // Returns True if the given thread is currently in a system call
 extern Bool VG_(is_in_syscall) ( Int tid );
 
+// Print the per-syscall call counts and (with --stats=yes) times.
+extern void VG_(print_syscall_stats) ( void );
+
 // Fix up a thread's state when syscall is interrupted by a signal.
 extern void VG_(fixup_guest_state_after_syscall_interrupted)(
                ThreadId tid,
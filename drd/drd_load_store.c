@@ -66,6 +66,45 @@
 
 static Bool s_check_stack_accesses = False;
 static Bool s_first_race_only      = False;
+static UInt s_sample_period        = 1;
+/*
+ * Number of memory accesses executed and checked by superblocks which are
+ * sampled. Only an estimate: all the accesses of a superblock are counted,
+ * even if it is exited early.
+ */
+static ULong s_sample_access_count;
+static ULong s_sample_checked_count;
+
+
+/* Local type definitions. */
+
+/*
+ * Sampling state of a superblock (--sample-period). A superblock that has
+ * not been executed much has all its executions checked. After every
+ * DRD_SAMPLE_BURST checked executions, the sampling period doubles, up to
+ * --sample-period.
+ */
+#define DRD_N_SAMPLERS   (1 << 16)
+#define DRD_SAMPLE_BURST 64
+
+typedef struct {
+   UInt n_checked; /* number of executions checked so far (saturating) */
+   UInt skip;      /* number of executions to skip before the next check */
+} Sampler;
+
+static Sampler* s_samplers;
+
+/*
+ * Sampling state for the superblock being instrumented. The guard is an
+ * Ity_I1 atom that is True if the memory accesses are checked this time
+ * and is generated upon the first memory access.
+ */
+static struct {
+   Sampler* sampler;    /* NULL if not sampling */
+   IRDirty* di;         /* call of drd_sample_sb(), once generated */
+   IRExpr*  guard;
+   UWord    n_accesses;
+} s_sb_sampling;
 
 
 /* Function definitions. */
@@ -92,6 +131,30 @@ void DRD_(set_first_race_only)(const Bool fro)
    s_first_race_only = fro;
 }
 
+UInt DRD_(get_sample_period)(void)
+{
+   return s_sample_period;
+}
+
+void DRD_(set_sample_period)(const UInt p)
+{
+   tl_assert(p >= 1);
+   s_sample_period = p;
+   if (p > 1 && !s_samplers)
+      s_samplers = VG_(calloc)("drd.load_store.ssp.1", DRD_N_SAMPLERS,
+                               sizeof(s_samplers[0]));
+}
+
+ULong DRD_(get_sample_access_count)(void)
+{
+   return s_sample_access_count;
+}
+
+ULong DRD_(get_sample_checked_count)(void)
+{
+   return s_sample_checked_count;
+}
+
 void DRD_(trace_mem_access)(const Addr addr, const SizeT size,
                             const BmAccessTypeT access_type,
                             const HWord stored_value_hi,
@@ -307,6 +370,90 @@ static VG_REGPARM(1) void drd_trace_store_8(Addr addr)
    }
 }
 
+/**
+ * Called upon the first memory access of each execution of a superblock
+ * that is sampled. Returns whether the memory accesses of the superblock
+ * are to be checked this time.
+ */
+static VG_REGPARM(2) HWord drd_sample_sb(Sampler* const s,
+                                         const HWord n_accesses)
+{
+   UInt k, period;
+
+   s_sample_access_count += n_accesses;
+   if (s->skip > 0) {
+      s->skip--;
+      return 0;
+   }
+   if (s->n_checked < 0xFFFFFFFF)
+      s->n_checked++;
+   k = s->n_checked / DRD_SAMPLE_BURST;
+   period = k >= 31 || (1U << k) > s_sample_period
+      ? s_sample_period : 1U << k;
+   s->skip = period - 1;
+   s_sample_checked_count += n_accesses;
+   return 1;
+}
+
+/**
+ * Compute the logical and of the Ity_I1 atoms arg1 and arg2.
+ */
+static IRExpr* mk_and1(IRSB* const bb, IRExpr* const arg1, IRExpr* const arg2)
+{
+   IRTemp wide1 = newIRTemp(bb->tyenv, Ity_I32);
+   IRTemp wide2 = newIRTemp(bb->tyenv, Ity_I32);
+   IRTemp anded = newIRTemp(bb->tyenv, Ity_I32);
+   IRTemp res   = newIRTemp(bb->tyenv, Ity_I1);
+
+   addStmtToIRSB(bb, IRStmt_WrTmp(wide1, IRExpr_Unop(Iop_1Uto32, arg1)));
+   addStmtToIRSB(bb, IRStmt_WrTmp(wide2, IRExpr_Unop(Iop_1Uto32, arg2)));
+   addStmtToIRSB(bb, IRStmt_WrTmp(anded, IRExpr_Binop(Iop_And32,
+                                                      IRExpr_RdTmp(wide1),
+                                                      IRExpr_RdTmp(wide2))));
+   addStmtToIRSB(bb, IRStmt_WrTmp(res, IRExpr_Unop(Iop_32to1,
+                                                   IRExpr_RdTmp(anded))));
+   return IRExpr_RdTmp(res);
+}
+
+/**
+ * Return the guard for a helper call that checks a memory access, given the
+ * guard of the access itself. If the superblock is sampled, the call of
+ * drd_sample_sb() is generated upon the first memory access.
+ */
+static IRExpr* sample_guard(IRSB* const bb, IRExpr* const guard)
+{
+   if (!s_sb_sampling.sampler)
+      return guard;
+
+   if (!s_sb_sampling.di) {
+      const IRType ty = sizeof(HWord) == 4 ? Ity_I32 : Ity_I64;
+      const IRTemp res = newIRTemp(bb->tyenv, ty);
+      const IRTemp g = newIRTemp(bb->tyenv, Ity_I1);
+
+      /* The number of accesses is filled in by DRD_(instrument)(). */
+      s_sb_sampling.di
+         = unsafeIRDirty_1_N(res, /*regparms*/2,
+                             "drd_sample_sb",
+                             VG_(fnptr_to_fnentry)(drd_sample_sb),
+                             mkIRExprVec_2(mkIRExpr_HWord((HWord)
+                                                 s_sb_sampling.sampler),
+                                           mkIRExpr_HWord(0)));
+      addStmtToIRSB(bb, IRStmt_Dirty(s_sb_sampling.di));
+      addStmtToIRSB(bb, IRStmt_WrTmp(g, ty == Ity_I32
+                                     ? IRExpr_Binop(Iop_CmpNE32,
+                                                    IRExpr_RdTmp(res),
+                                                    mkIRExpr_HWord(0))
+                                     : IRExpr_Binop(Iop_CmpNE64,
+                                                    IRExpr_RdTmp(res),
+                                                    mkIRExpr_HWord(0))));
+      s_sb_sampling.guard = IRExpr_RdTmp(g);
+   }
+   s_sb_sampling.n_accesses++;
+
+   return guard ? mk_and1(bb, guard, s_sb_sampling.guard)
+      : s_sb_sampling.guard;
+}
+
 /**
  * Return true if and only if addr_expr matches the pattern (SP) or
  * <offset>(SP).
@@ -474,7 +621,7 @@ static void instr_trace_mem_store(IRSB* const bb, IRExpr* const addr_expr,
 
 static void instrument_load(IRSB* const bb, IRExpr* const addr_expr,
                             const HWord size,
-                            IRExpr* const guard/* NULL => True */)
+                            IRExpr* guard/* NULL => True */)
 {
    IRExpr* size_expr;
    IRExpr** argv;
@@ -522,13 +669,14 @@ static void instrument_load(IRSB* const bb, IRExpr* const addr_expr,
                              argv);
       break;
    }
+   guard = sample_guard(bb, guard);
    if (guard) di->guard = guard;
    addStmtToIRSB(bb, IRStmt_Dirty(di));
 }
 
 static void instrument_store(IRSB* const bb, IRExpr* addr_expr,
                              IRExpr* const data_expr,
-                             IRExpr* const guard_expr/* NULL => True */)
+                             IRExpr* guard_expr/* NULL => True */)
 {
    IRExpr* size_expr;
    IRExpr** argv;
@@ -586,6 +734,7 @@ static void instrument_store(IRSB* const bb, IRExpr* addr_expr,
                              argv);
       break;
    }
+   guard_expr = sample_guard(bb, guard_expr);
    if (guard_expr) di->guard = guard_expr;
    addStmtToIRSB(bb, IRStmt_Dirty(di));
 }
@@ -602,6 +751,7 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
    Int      i;
    IRSB*    bb;
    IRExpr** argv;
+   IRExpr*  guard;
    Bool     instrument = True;
 
    /* Set up BB */
@@ -611,6 +761,15 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
    bb->jumpkind = bb_in->jumpkind;
    bb->offsIP   = bb_in->offsIP;
 
+   s_sb_sampling.sampler = NULL;
+   s_sb_sampling.di = NULL;
+   s_sb_sampling.guard = NULL;
+   s_sb_sampling.n_accesses = 0;
+   if (s_sample_period > 1) {
+      const UWord h = (UWord)((vge->base[0] * 0x9E3779B97F4A7C15ULL) >> 48);
+      s_sb_sampling.sampler = &s_samplers[h % DRD_N_SAMPLERS];
+   }
+
    for (i = 0; i < bb_in->stmts_used; i++)
    {
       IRStmt* const st = bb_in->stmts[i];
@@ -714,6 +873,8 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
                           "drd_trace_load",
                           VG_(fnptr_to_fnentry)(DRD_(trace_load)),
                           argv);
+                  guard = sample_guard(bb, NULL);
+                  if (guard) di->guard = guard;
                   addStmtToIRSB(bb, IRStmt_Dirty(di));
                }
                if (mFx == Ifx_Write || mFx == Ifx_Modify)
@@ -723,6 +884,8 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
                           "drd_trace_store",
                           VG_(fnptr_to_fnentry)(DRD_(trace_store)),
                           argv);
+                  guard = sample_guard(bb, NULL);
+                  if (guard) di->guard = guard;
                   addStmtToIRSB(bb, IRStmt_Dirty(di));
                }
                break;
@@ -806,6 +969,9 @@ IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
       }
    }
 
+   if (s_sb_sampling.di)
+      s_sb_sampling.di->args[1] = mkIRExpr_HWord(s_sb_sampling.n_accesses);
+
    return bb;
 }
 
@@ -39,6 +39,10 @@ Bool DRD_(get_check_stack_accesses)(void);
 void DRD_(set_check_stack_accesses)(const Bool c);
 Bool DRD_(get_first_race_only)(void);
 void DRD_(set_first_race_only)(const Bool fro);
+UInt DRD_(get_sample_period)(void);
+void DRD_(set_sample_period)(const UInt p);
+ULong DRD_(get_sample_access_count)(void);
+ULong DRD_(get_sample_checked_count)(void);
 IRSB* DRD_(instrument)(VgCallbackClosure* const closure,
                        IRSB* const bb_in,
                        const VexGuestLayout* const layout,
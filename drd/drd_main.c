@@ -72,6 +72,7 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
    int exclusive_threshold_ms = -1;
    int first_race_only        = -1;
    int report_signal_unlocked = -1;
+   int sample_period          = -1;
    int segment_merging        = -1;
    int segment_merge_interval = -1;
    int shared_threshold_ms    = -1;
@@ -99,6 +100,8 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
    else if VG_BOOL_CLO(arg, "--free-is-write",       DRD_(g_free_is_write)) {}
    else if VG_BOOL_CLO(arg,"--report-signal-unlocked",report_signal_unlocked)
    {}
+   else if VG_BINT_CLO(arg, "--sample-period",       sample_period, 1, 1000000)
+   {}
    else if VG_BOOL_CLO(arg, "--segment-merging",     segment_merging) {}
    else if VG_INT_CLO (arg, "--segment-merging-interval", segment_merge_interval)
    {}
@@ -152,6 +155,8 @@ static Bool DRD_(process_cmd_line_option)(const HChar* arg)
    {
       DRD_(rwlock_set_shared_threshold)(shared_threshold_ms);
    }
+   if (sample_period != -1)
+      DRD_(set_sample_period)(sample_period);
    if (segment_merging != -1)
       DRD_(thread_set_segment_merging)(segment_merging);
    if (segment_merge_interval != -1)
@@ -218,6 +223,9 @@ static void DRD_(print_usage)(void)
 "                              pthread_cond_signal() where the mutex associated\n"
 "                              with the signal via pthread_cond_wait() is not\n"
 "                              locked at the time the signal is sent [yes].\n"
+"    --sample-period=<n>       Once code has been executed often, only check\n"
+"                              its memory accesses one time out of about n\n"
+"                              [1].\n"
 "    --segment-merging=yes|no  Controls segment merging [yes].\n"
 "        Segment merging is an algorithm to limit memory usage of the\n"
 "        data race detection algorithm. Disabling segment merging may\n"
@@ -766,6 +774,20 @@ static void DRD_(fini)(Int exitcode)
                    "rerun with: -v\n");
    }
 
+   if (DRD_(get_sample_period)() > 1 && VG_(clo_verbosity) >= 1
+       && !VG_(clo_xml))
+   {
+      const ULong accesses = DRD_(get_sample_access_count)();
+      const ULong checked = DRD_(get_sample_checked_count)();
+      const ULong permille = accesses ? 1000 * checked / accesses : 1000;
+
+      VG_(message)(Vg_UserMsg,
+                   "--sample-period=%u: checked about %llu of %llu memory"
+                   " accesses (%llu.%llu%%).\n",
+                   DRD_(get_sample_period)(), checked, accesses,
+                   permille / 10, permille % 10);
+   }
+
    if ((VG_(clo_stats) || s_print_stats) && !VG_(clo_xml))
    {
       ULong pu = DRD_(thread_get_update_conflict_set_count)();
@@ -83,8 +83,12 @@ Bool  HG_(clo_free_is_write) = False;
 
 UWord HG_(clo_vts_pruning) = 1;
 
+Bool  HG_(clo_vts_epochs) = True;
+
 Bool  HG_(clo_check_stack_refs) = True;
 
+UWord HG_(clo_sample_period) = 1;
+
 /*--------------------------------------------------------------------*/
 /*--- end                                              hg_basics.c ---*/
 /*--------------------------------------------------------------------*/
@@ -122,10 +122,22 @@ extern Bool HG_(clo_free_is_write);
       mostly a big time waster, but minimises space use. */
 extern UWord HG_(clo_vts_pruning);
 
+/* When True, VTSs which are a thread's write clock are marked as
+   such, so that comparisons against them need only look at that
+   thread's entry.  This doesn't change the results.  Default: True. */
+extern Bool HG_(clo_vts_epochs);
+
 /* When False, race checking ignores memory references which are to
    the stack, which speeds things up a bit.  Default: True. */
 extern Bool HG_(clo_check_stack_refs); 
 
+/* When greater than 1, race checking samples memory accesses.  Code
+   that has been executed often has its memory accesses checked only
+   in about 1 out of N executions.  Code that has not been executed
+   much is always checked, as are synchronisation events.  Races can
+   then be missed, but no false ones are reported.  Default: 1. */
+extern UWord HG_(clo_sample_period);
+
 #endif /* ! __HG_BASICS_H */
 
 /*--------------------------------------------------------------------*/
@@ -3479,12 +3479,35 @@ typedef
    struct {
       WordSetID inns; /* in univ_laog */
       WordSetID outs; /* in univ_laog */
+      Word      ord;  /* position in the topological order, see below */
+      UInt      mark; /* == laog_mark_gen if visited by the current search */
    }
    LAOGLinks;
 
 /* lock order acquisition graph */
 static WordFM* laog = NULL; /* WordFM Lock* LAOGLinks* */
 
+/* A topological order of the nodes of laog, maintained incrementally
+   as edges are added, following Pearce and Kelly, "A Dynamic
+   Topological Sort Algorithm for Directed Acyclic Graphs" (2006).
+   For every edge src --> dst, src's ord is smaller than dst's, so
+   L1 --*--> L2 implies ord(L1) < ord(L2).  This lets
+   laog__do_dfs_from_to answer most queries without searching the
+   graph, and prune the searches it still has to do.
+
+   The order only exists while laog has no cycle.  When a lock order
+   error closes a cycle, laog_ord_valid becomes False for good, and all
+   queries search the whole graph. */
+static Bool laog_ord_valid = True;
+static Word laog_ord_lo    = 0; /* ords given to new nodes: */
+static Word laog_ord_hi    = 0; /* first or last in the order */
+static UInt laog_mark_gen  = 0;
+
+static UWord stats__laog_queries        = 0;
+static UWord stats__laog_queries_dfs    = 0;
+static UWord stats__laog_reorders       = 0;
+static UWord stats__laog_reordered_nodes = 0;
+
 /* EXPOSITION ONLY: for each edge in 'laog', record the two places
    where that edge was created, so that we can show the user later if
    we need to. */
@@ -3627,10 +3650,134 @@ static void univ_laog_do_GC ( void ) {
 }
 
 
+static LAOGLinks* laog__links ( Lock* lk ) {
+   LAOGLinks* links = NULL;
+   if (VG_(lookupFM)( laog, NULL, (UWord*)&links, (UWord)lk )) {
+      tl_assert(links);
+      return links;
+   }
+   return NULL;
+}
+
+static Int cmp_LAOGLinks_by_ord ( const void* a, const void* b ) {
+   const LAOGLinks* l1 = *(LAOGLinks* const *)a;
+   const LAOGLinks* l2 = *(LAOGLinks* const *)b;
+   if (l1->ord < l2->ord) return -1;
+   if (l1->ord > l2->ord) return  1;
+   return 0;
+}
+
+static Int cmp_Word ( const void* a, const void* b ) {
+   Word w1 = *(const Word*)a;
+   Word w2 = *(const Word*)b;
+   if (w1 < w2) return -1;
+   if (w1 > w2) return  1;
+   return 0;
+}
+
+/* Collect in 'acc' the nodes reachable from 'start' (inclusive)
+   through nodes whose ord lies strictly between 'lo' and 'hi',
+   following the out edges if 'fwd', else the in edges.  Returns False
+   if 'avoid' is reachable that way. */
+static Bool laog__pk_search ( LAOGLinks* start, Bool fwd, Word lo, Word hi,
+                              LAOGLinks* avoid, XArray* acc /* LAOGLinks* */ )
+{
+   XArray*    stack = VG_(newXA)( HG_(zalloc), "hg.lpks.1", HG_(free),
+                                  sizeof(LAOGLinks*) );
+   LAOGLinks* here;
+   UWord*     words;
+   UWord      size, i;
+   Bool       ok = True;
+
+   start->mark = laog_mark_gen;
+   VG_(addToXA)( stack, &start );
+   while (VG_(sizeXA)( stack ) > 0) {
+      here = *(LAOGLinks**)VG_(indexXA)( stack, VG_(sizeXA)( stack ) - 1 );
+      VG_(dropTailXA)( stack, 1 );
+      VG_(addToXA)( acc, &here );
+      HG_(getPayloadWS)( &words, &size, univ_laog,
+                         fwd ? here->outs : here->inns );
+      for (i = 0; i < size; i++) {
+         LAOGLinks* next = laog__links( (Lock*)words[i] );
+         tl_assert(next);
+         if (next == avoid) {
+            ok = False;
+            goto out;
+         }
+         if (next->mark != laog_mark_gen
+             && next->ord > lo && next->ord < hi) {
+            next->mark = laog_mark_gen;
+            VG_(addToXA)( stack, &next );
+         }
+      }
+   }
+  out:
+   VG_(deleteXA)( stack );
+   return ok;
+}
+
+/* The edge src --> dst has just been added to laog.  Update the
+   topological order, or invalidate it if the edge closes a cycle. */
+static void laog__order_edge ( LAOGLinks* src, LAOGLinks* dst ) {
+   XArray *fwd, *bwd, *ords;
+   Word   i, nF, nB;
+
+   if (!laog_ord_valid || src->ord < dst->ord)
+      return;
+
+   /* The nodes affected are those reachable from dst, and those
+      reaching src, with an ord between dst's and src's.  If src is
+      reachable from dst, there is a cycle. */
+   laog_mark_gen++;
+   fwd = VG_(newXA)( HG_(zalloc), "hg.loe.1", HG_(free), sizeof(LAOGLinks*) );
+   if (!laog__pk_search( dst, True/*fwd*/, dst->ord, src->ord, src, fwd )) {
+      VG_(deleteXA)( fwd );
+      laog_ord_valid = False;
+      if (VG_(clo_stats))
+         VG_(message)(Vg_DebugMsg,
+                      "laog: cycle found, no longer maintaining its "
+                      "topological order\n");
+      return;
+   }
+   bwd = VG_(newXA)( HG_(zalloc), "hg.loe.2", HG_(free), sizeof(LAOGLinks*) );
+   (void) laog__pk_search( src, False/*!fwd*/, dst->ord, src->ord,
+                           NULL, bwd );
+
+   /* Give the nodes reaching src the lowest of their ords, keeping
+      their relative order, followed by the nodes reachable from dst. */
+   nF = VG_(sizeXA)( fwd );
+   nB = VG_(sizeXA)( bwd );
+   VG_(setCmpFnXA)( fwd, cmp_LAOGLinks_by_ord );
+   VG_(setCmpFnXA)( bwd, cmp_LAOGLinks_by_ord );
+   VG_(sortXA)( fwd );
+   VG_(sortXA)( bwd );
+   ords = VG_(newXA)( HG_(zalloc), "hg.loe.3", HG_(free), sizeof(Word) );
+   for (i = 0; i < nB; i++)
+      VG_(addToXA)( ords, &(*(LAOGLinks**)VG_(indexXA)( bwd, i ))->ord );
+   for (i = 0; i < nF; i++)
+      VG_(addToXA)( ords, &(*(LAOGLinks**)VG_(indexXA)( fwd, i ))->ord );
+   VG_(setCmpFnXA)( ords, cmp_Word );
+   VG_(sortXA)( ords );
+   for (i = 0; i < nB; i++)
+      (*(LAOGLinks**)VG_(indexXA)( bwd, i ))->ord
+         = *(Word*)VG_(indexXA)( ords, i );
+   for (i = 0; i < nF; i++)
+      (*(LAOGLinks**)VG_(indexXA)( fwd, i ))->ord
+         = *(Word*)VG_(indexXA)( ords, nB + i );
+   tl_assert(src->ord < dst->ord);
+
+   stats__laog_reorders++;
+   stats__laog_reordered_nodes += nF + nB;
+   VG_(deleteXA)( ords );
+   VG_(deleteXA)( bwd );
+   VG_(deleteXA)( fwd );
+}
+
 __attribute__((noinline))
 static void laog__add_edge ( Lock* src, Lock* dst ) {
    UWord      keyW;
    LAOGLinks* links;
+   LAOGLinks* src_links;
    Bool       presentF, presentR;
    if (0) VG_(printf)("laog__add_edge %p %p\n", src, dst);
 
@@ -3658,8 +3805,11 @@ static void laog__add_edge ( Lock* src, Lock* dst ) {
       links = HG_(zalloc)("hg.lae.1", sizeof(LAOGLinks));
       links->inns = HG_(emptyWS)( univ_laog );
       links->outs = HG_(singletonWS)( univ_laog, (UWord)dst );
+      /* No in edges: it can go first. */
+      links->ord  = --laog_ord_lo;
       VG_(addToFM)( laog, (UWord)src, (UWord)links );
    }
+   src_links = links;
    /* Update the in edges for dst */
    keyW  = 0;
    links = NULL;
@@ -3674,11 +3824,16 @@ static void laog__add_edge ( Lock* src, Lock* dst ) {
       links = HG_(zalloc)("hg.lae.2", sizeof(LAOGLinks));
       links->inns = HG_(singletonWS)( univ_laog, (UWord)src );
       links->outs = HG_(emptyWS)( univ_laog );
+      /* No out edges: it can go last. */
+      links->ord  = ++laog_ord_hi;
       VG_(addToFM)( laog, (UWord)dst, (UWord)links );
    }
 
    tl_assert( (presentF && presentR) || (!presentF && !presentR) );
 
+   if (!presentF)
+      laog__order_edge( src_links, links );
+
    if (!presentF && src->acquired_at && dst->acquired_at) {
       LAOGLinkExposition expo;
       /* If this edge is entering the graph, and we have acquired_at
@@ -3811,6 +3966,9 @@ static void laog__sanity_check ( const HChar* who ) {
                              laog__preds( (Lock*)ws_words[i] ), 
                              (UWord)me ))
             goto bad;
+         if (laog_ord_valid
+             && laog__links( (Lock*)ws_words[i] )->ord <= links->ord)
+            goto bad;
       }
       me = NULL;
       links = NULL;
@@ -3827,7 +3985,9 @@ static void laog__sanity_check ( const HChar* who ) {
 /* If there is a path in laog from 'src' to any of the elements in
    'dst', return an arbitrarily chosen element of 'dst' reachable from
    'src'.  If no path exist from 'src' to any element in 'dst', return
-   NULL. */
+   NULL.  While laog_ord_valid, only locks after 'src' and not after
+   the last element of 'dst' in the topological order need to be
+   visited, and there is often none. */
 __attribute__((noinline))
 static
 Lock* laog__do_dfs_from_to ( Lock* src, WordSetID dsts /* univ_lsets */ )
@@ -3840,6 +4000,7 @@ Lock* laog__do_dfs_from_to ( Lock* src, WordSetID dsts /* univ_lsets */ )
    WordSetID succs;
    UWord     succs_size, i;
    UWord*    succs_words;
+   Word      ord_limit = 0;
    //laog__sanity_check();
 
    /* If the destination set is empty, we can never get there from
@@ -3847,6 +4008,33 @@ Lock* laog__do_dfs_from_to ( Lock* src, WordSetID dsts /* univ_lsets */ )
    if (HG_(isEmptyWS)( univ_lsets, dsts ))
       return NULL;
 
+   stats__laog_queries++;
+   if (laog_ord_valid) {
+      LAOGLinks* src_links;
+      LAOGLinks* dst_links;
+      UWord*     dsts_words;
+      UWord      dsts_size;
+      Bool       any = False;
+
+      if (HG_(elemWS)( univ_lsets, dsts, (UWord)src ))
+         return src;
+      src_links = laog__links( src );
+      if (!src_links)
+         return NULL;
+      HG_(getPayloadWS)( &dsts_words, &dsts_size, univ_lsets, dsts );
+      for (i = 0; i < dsts_size; i++) {
+         dst_links = laog__links( (Lock*)dsts_words[i] );
+         if (dst_links && dst_links->ord > src_links->ord
+             && (!any || dst_links->ord > ord_limit)) {
+            ord_limit = dst_links->ord;
+            any = True;
+         }
+      }
+      if (!any)
+         return NULL;
+   }
+   stats__laog_queries_dfs++;
+
    ret     = NULL;
    stack   = VG_(newXA)( HG_(zalloc), "hg.lddft.1", HG_(free), sizeof(Lock*) );
    visited = VG_(newFM)( HG_(zalloc), "hg.lddft.2", HG_(free), NULL/*unboxedcmp*/ );
@@ -3869,6 +4057,10 @@ Lock* laog__do_dfs_from_to ( Lock* src, WordSetID dsts /* univ_lsets */ )
 
       VG_(addToFM)( visited, (UWord)here, 0 );
 
+      /* Nothing after ord_limit can lead to an element of dsts. */
+      if (laog_ord_valid && laog__links( here )->ord > ord_limit)
+         continue;
+
       succs = laog__succs( here );
       HG_(getPayloadWS)( &succs_words, &succs_size, univ_laog, succs );
       for (i = 0; i < succs_size; i++)
@@ -4416,6 +4608,87 @@ static IRExpr* mk_And1 ( IRSB* sbOut, IRExpr* arg1, IRExpr* arg2 )
    return mkexpr(res);
 }
 
+/* --sample-period support.  Each superblock gets a Sampler, picked
+   by hashing the superblock's guest address.  Each time the
+   superblock is executed, the first memory access in it calls
+   hg_sample_sb, which decides whether the accesses are checked this
+   time round.  A cold superblock has all its executions checked.
+   After every HG_SAMPLE_BURST checked executions, the sampling period
+   doubles, up to --sample-period. */
+#define HG_N_SAMPLERS   (1 << 16)
+#define HG_SAMPLE_BURST 64
+
+typedef
+   struct {
+      UInt n_checked; /* # executions checked so far (saturating) */
+      UInt skip;      /* # executions to skip before the next check */
+   }
+   Sampler;
+
+static Sampler* samplers = NULL;
+
+/* Number of memory accesses executed and checked, in superblocks
+   which are sampled.  Only an estimate: all the accesses of a
+   superblock are counted, even if it is exited early. */
+static ULong stats__sample_accesses = 0;
+static ULong stats__sample_checked  = 0;
+
+static VG_REGPARM(2) UWord hg_sample_sb ( Sampler* s, UWord n_accesses )
+{
+   UInt k, period;
+
+   stats__sample_accesses += n_accesses;
+   if (s->skip > 0) {
+      s->skip--;
+      return 0;
+   }
+   if (s->n_checked < 0xFFFFFFFF)
+      s->n_checked++;
+   k = s->n_checked / HG_SAMPLE_BURST;
+   period = k >= 31 || (1U << k) > HG_(clo_sample_period)
+            ? HG_(clo_sample_period) : 1U << k;
+   s->skip = period - 1;
+   stats__sample_checked += n_accesses;
+   return 1;
+}
+
+/* Sampling state for the superblock being instrumented.  guard is an
+   Ity_I1 atom, True if the accesses are to be checked this time round,
+   and is generated at the first memory access. */
+static struct {
+   Sampler* sampler;    /* NULL if not sampling */
+   IRDirty* di;         /* the call to hg_sample_sb, once generated */
+   IRExpr*  guard;
+   UWord    n_accesses;
+} sb_sampling;
+
+static IRExpr* mk_sample_guard ( IRSB* sbOut, Int hWordTy_szB )
+{
+   if (!sb_sampling.di) {
+      IRType ty = hWordTy_szB == 4 ? Ity_I32 : Ity_I64;
+      IRTemp res = newIRTemp(sbOut->tyenv, ty);
+      IRTemp g   = newIRTemp(sbOut->tyenv, Ity_I1);
+      /* The nr of accesses is filled in by hg_instrument, once it is
+         known. */
+      sb_sampling.di
+         = unsafeIRDirty_1_N( res, 2, "hg_sample_sb",
+                              VG_(fnptr_to_fnentry)( &hg_sample_sb ),
+                              mkIRExprVec_2(
+                                 mkIRExpr_HWord( (HWord)sb_sampling.sampler ),
+                                 mkIRExpr_HWord( 0 ) ) );
+      addStmtToIRSB( sbOut, IRStmt_Dirty(sb_sampling.di) );
+      addStmtToIRSB(
+         sbOut,
+         assign(g, ty == Ity_I32
+                   ? binop(Iop_CmpNE32, mkexpr(res), mkU32(0))
+                   : binop(Iop_CmpNE64, mkexpr(res), mkU64(0)))
+      );
+      sb_sampling.guard = mkexpr(g);
+   }
+   sb_sampling.n_accesses++;
+   return sb_sampling.guard;
+}
+
 static void instrument_mem_access ( IRSB*   sbOut, 
                                     IRExpr* addr,
                                     Int     szB,
@@ -4577,6 +4850,13 @@ static void instrument_mem_access ( IRSB*   sbOut,
       di->guard = mk_And1(sbOut, di->guard, guard);
    }
 
+   /* Likewise if this execution of the superblock might not be
+      checked. */
+   if (sb_sampling.sampler) {
+      di->guard = mk_And1(sbOut, di->guard,
+                          mk_sample_guard(sbOut, hWordTy_szB));
+   }
+
    /* Add the helper. */
    addStmtToIRSB( sbOut, IRStmt_Dirty(di) );
 }
@@ -4640,6 +4920,15 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
       i++;
    }
 
+   sb_sampling.sampler = NULL;
+   sb_sampling.di = NULL;
+   sb_sampling.guard = NULL;
+   sb_sampling.n_accesses = 0;
+   if (HG_(clo_sample_period) > 1) {
+      UWord h = (UWord)((vge->base[0] * 0x9E3779B97F4A7C15ULL) >> 48);
+      sb_sampling.sampler = &samplers[h % HG_N_SAMPLERS];
+   }
+
    // Get the first statement, and initial cia from it
    tl_assert(bbIn->stmts_used > 0);
    tl_assert(i < bbIn->stmts_used);
@@ -4841,6 +5130,9 @@ IRSB* hg_instrument ( VgCallbackClosure* closure,
       addStmtToIRSB( bbOut, st );
    } /* iterate over bbIn->stmts */
 
+   if (sb_sampling.di)
+      sb_sampling.di->args[1] = mkIRExpr_HWord( sb_sampling.n_accesses );
+
    return bbOut;
 }
 
@@ -5550,9 +5842,13 @@ static Bool hg_process_cmd_line_option ( const HChar* arg )
                             HG_(clo_vts_pruning), 1);
    else if VG_XACT_CLO(arg, "--vts-pruning=always",
                             HG_(clo_vts_pruning), 2);
+   else if VG_BOOL_CLO(arg, "--vts-epochs",
+                            HG_(clo_vts_epochs)) {}
 
    else if VG_BOOL_CLO(arg, "--check-stack-refs",
                             HG_(clo_check_stack_refs)) {}
+   else if VG_BINT_CLO(arg, "--sample-period",
+                       HG_(clo_sample_period), 1, 1000*1000) {}
    else if VG_BOOL_CLO(arg, "--ignore-thread-creation",
                             HG_(clo_ignore_thread_creation)) {}
 
@@ -5574,6 +5870,8 @@ static void hg_print_usage ( void )
 "    --conflict-cache-size=N   size of 'full' history cache [2000000]\n"
 "    --check-stack-refs=no|yes race-check reads and writes on the\n"
 "                              main stack and thread stacks? [yes]\n"
+"    --sample-period=N         once code is hot, race-check its memory\n"
+"                              accesses only 1 time out of about N [1]\n"
 "    --ignore-thread-creation=yes|no Ignore activities during thread\n"
 "                              creation [%s]\n",
 HG_(clo_ignore_thread_creation) ? "yes" : "no"
@@ -5599,6 +5897,8 @@ static void hg_print_debug_usage ( void )
 "       never:   is never done (may cause big space leaks in Helgrind)\n"
 "       auto:    done just often enough to keep space usage under control\n"
 "       always:  done after every VTS GC (mostly just a big time waster)\n"
+"    --vts-epochs=no|yes       compare VTSs against thread write clocks\n"
+"                              by epoch [yes]\n"
     );
 }
 
@@ -5611,6 +5911,12 @@ static void hg_print_stats (void)
       if (HG_(clo_track_lockorders)) {
          VG_(printf)("\n");
          HG_(ppWSUstats)( univ_laog,  "univ_laog" );
+         VG_(printf)(" laog: %'lu order queries, %'lu needed a search\n",
+                     stats__laog_queries, stats__laog_queries_dfs);
+         VG_(printf)(" laog: %'lu reorders, moving %'lu nodes; "
+                     "order %s\n",
+                     stats__laog_reorders, stats__laog_reordered_nodes,
+                     laog_ord_valid ? "valid" : "abandoned (cycle)");
       }
    }
 
@@ -5687,6 +5993,17 @@ static void hg_fini ( Int exitcode )
    if (HG_(clo_sanity_flags))
       all__sanity_check("SK_(fini)");
 
+   if (HG_(clo_sample_period) > 1 && VG_(clo_verbosity) >= 1
+       && !VG_(clo_xml)) {
+      ULong permille = stats__sample_accesses == 0 ? 1000
+         : (1000 * stats__sample_checked) / stats__sample_accesses;
+      VG_(umsg)("--sample-period=%lu: checked about %'llu of %'llu memory "
+                "accesses (%llu.%llu%%)\n",
+                HG_(clo_sample_period),
+                stats__sample_checked, stats__sample_accesses,
+                permille / 10, permille % 10);
+   }
+
    if (VG_(clo_stats))
       hg_print_stats();
 }
@@ -5740,6 +6057,10 @@ static void hg_post_clo_init ( void )
       laog__init();
 
    initialise_data_structures(hbthr_root);
+
+   if (HG_(clo_sample_period) > 1)
+      samplers = HG_(zalloc)( "hg.hpci.1 (samplers)",
+                              HG_N_SAMPLERS * sizeof(Sampler) );
 }
 
 static void hg_info_location (Addr a)
@@ -35,9 +35,9 @@
 #include "pub_tool_libcassert.h"
 #include "pub_tool_libcbase.h"
 #include "pub_tool_libcprint.h"
+#include "pub_tool_libcproc.h"       // VG_(read_millisecond_timer)
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_wordfm.h"
-#include "pub_tool_hashtable.h"
 #include "pub_tool_xarray.h"
 #include "pub_tool_oset.h"
 #include "pub_tool_threadstate.h"
@@ -542,10 +542,18 @@ static inline LineF *LineF_Ptr (LineZ *lineZ)
 typedef
    struct {
       UInt   magic;
+      UInt   vts_gen; /* vts_tab generation of the VtsIDs in linesZ */
       LineZ  linesZ[N_SECMAP_ZLINES];
    }
    SecMap;
 
+/* VTS pruning makes a new vts_tab, and renumbers all VtsIDs.  The
+   VtsIDs in shadow memory are renumbered lazily, a SecMap at a time:
+   a SecMap whose .vts_gen is not vts_tab_gen is renumbered when it is
+   first looked up, or in the background by vts_remap_step. */
+static UInt vts_tab_gen = 0;
+static void vts_remap_SecMap ( SecMap* sm ); /* fwds */
+
 #define SecMap_MAGIC   0x571e58cbU
 
 // (UInt) `echo "Free SecMap" | md5sum`
@@ -635,6 +643,10 @@ static UWord stats__vts__cmpLEQ          = 0; // # calls to VTS__cmpLEQ
 static UWord stats__vts__cmp_structural  = 0; // # calls to VTS__cmp_structural
 static UWord stats__vts_tab_GC           = 0; // # nr of vts_tab GC
 static UWord stats__vts_pruning          = 0; // # nr of vts pruning
+static UWord stats__vts_GC_ms_total      = 0; // # ms spent in vts_tab GC
+static UWord stats__vts_GC_ms_max        = 0; // # longest vts_tab GC, in ms
+static UWord stats__vts_remap_touched    = 0; // # SecMaps remapped on lookup
+static UWord stats__vts_remap_background = 0; // # SecMaps remapped in bg
 
 // # calls to VTS__cmp_structural w/ slow case
 static UWord stats__vts__cmp_structural_slow = 0;
@@ -765,6 +777,7 @@ static SecMap* shmem__alloc_or_recycle_SecMap ( void )
    if (0) VG_(printf)("alloc_SecMap %p\n",sm);
    tl_assert(sm);
    sm->magic = SecMap_MAGIC;
+   sm->vts_gen = vts_tab_gen;
    for (i = 0; i < N_SECMAP_ZLINES; i++) {
       sm->linesZ[i].dict[0] = SVal_NOACCESS;
       sm->linesZ[i].dict[1] = SVal_INVALID;
@@ -804,6 +817,10 @@ static SecMap* shmem__find_SecMap ( Addr ga )
    if (VG_(lookupFM)( map_shmem,
                       NULL/*keyP*/, (UWord*)&sm, (UWord)gaKey )) {
       tl_assert(sm != NULL);
+      /* smCache is flushed when vts_tab_gen changes, so only SecMaps
+         found here can need renumbering. */
+      if (UNLIKELY(sm->vts_gen != vts_tab_gen))
+         vts_remap_SecMap(sm);
       smCache[2] = smCache[1];
       smCache[1] = smCache[0];
       smCache[0].gaKey = gaKey;
@@ -2155,6 +2172,9 @@ static void VTS__show ( const VTS* vts );
 /* Debugging only.  Return vts[index], so to speak. */
 static ULong VTS__indexAt_SLOW ( VTS* vts, Thr* idx );
 
+/* Return vts[thrid], so to speak, by binary search. */
+static ULong VTS__indexAt_ThrID ( VTS* vts, ThrID thrid );
+
 /* Notify the VTS machinery that a thread has been declared
    comprehensively dead: that is, it has done an async exit AND it has
    been joined with.  This should ensure that its local clocks (.viR
@@ -2649,6 +2669,25 @@ ULong VTS__indexAt_SLOW ( VTS* vts, Thr* idx )
 }
 
 
+/* See comment on prototype above.
+*/
+ULong VTS__indexAt_ThrID ( VTS* vts, ThrID thrid )
+{
+   Word lo = 0, hi = (Word)vts->usedTS - 1;
+   while (lo <= hi) {
+      Word mid = (lo + hi) / 2;
+      ScalarTS* st = &vts->ts[mid];
+      if (st->thrid < thrid)
+         lo = mid + 1;
+      else if (st->thrid > thrid)
+         hi = mid - 1;
+      else
+         return st->tym;
+   }
+   return 0;
+}
+
+
 /* See comment on prototype above.
 */
 static void VTS__declare_thread_very_dead ( Thr* thr )
@@ -2757,6 +2796,11 @@ static void VtsID__invalidate_caches ( void ); /* fwds */
    - .vts->id == this entry number
    - no specific value for .rc (even 0 is OK)
    - this entry is not on freelist, so u.freelink == VtsID_INVALID
+
+   .epoch is only meaningful when .vts != NULL.  If .epoch.thrid is
+   nonzero, then .vts is (has been) the write clock (.viW) of that
+   thread, and .epoch.tym is that thread's own entry in .vts.  See
+   VtsID__cmpLEQ_WRK for why that is useful.
 */
 typedef
    struct {
@@ -2768,6 +2812,7 @@ typedef
       } u; 
       /* u.freelink only used when vts == NULL,
          u.remap only used when vts != NULL, during pruning. */
+      ScalarTS epoch;
    }
    VtsTE;
 
@@ -2830,6 +2875,8 @@ static VtsID get_new_VtsID ( void )
    te.vts = NULL;
    te.rc = 0;
    te.u.freelink = VtsID_INVALID;
+   te.epoch.thrid = 0;
+   te.epoch.tym = 0;
    ii = (VtsID)VG_(addToXA)( vts_tab, &te );
    return ii;
 }
@@ -2883,6 +2930,8 @@ static VtsID vts_tab__find__or__clone_and_add ( VTS* cand )
       ie->vts = in_tab;
       ie->rc = 0;
       ie->u.freelink = VtsID_INVALID;
+      ie->epoch.thrid = 0;
+      ie->epoch.tym = 0;
       in_tab->id = ii;
       return ii;
    }
@@ -2955,6 +3004,99 @@ void remap_VtsIDs_in_SVal ( /*MOD*/XArray* /* of VtsTE */ old_tab,
 }
 
 
+/* --- Lazy renumbering of the VtsIDs in shadow memory --- */
+
+/* The vts_tab before the last pruning, while there are still SecMaps
+   with VtsIDs from it (i.e. with .vts_gen == vts_tab_gen - 1), else
+   NULL.  Only the u.remap and rc fields of its entries are used. */
+static XArray* /* of VtsTE */ vts_remap_old_tab = NULL;
+
+/* vts_remap_step continues from the SecMap at this address. */
+static Addr vts_remap_next_ga = 0;
+
+/* Max nr of SecMaps looked at by one vts_remap_step call. */
+#define VTS_REMAP_STEP_SECMAPS 1024
+
+/* Renumber all the VtsIDs in SM into the current vts_tab. */
+static void vts_remap_SecMap ( SecMap* sm )
+{
+   UWord i, j;
+   tl_assert(sm->magic == SecMap_MAGIC);
+   tl_assert(vts_remap_old_tab != NULL);
+   tl_assert(sm->vts_gen + 1 == vts_tab_gen);
+   for (i = 0; i < N_SECMAP_ZLINES; i++) {
+      LineZ* lineZ = &sm->linesZ[i];
+      if (lineZ->dict[0] != SVal_INVALID) {
+         for (j = 0; j < 4; j++)
+            remap_VtsIDs_in_SVal(vts_remap_old_tab, vts_tab,
+                                 &lineZ->dict[j]);
+      } else {
+         LineF* lineF = SVal2Ptr (lineZ->dict[1]);
+         for (j = 0; j < N_LINE_ARANGE; j++)
+            remap_VtsIDs_in_SVal(vts_remap_old_tab, vts_tab,
+                                 &lineF->w64s[j]);
+      }
+   }
+   sm->vts_gen = vts_tab_gen;
+   stats__vts_remap_touched++;
+}
+
+/* All VtsIDs have been renumbered: check the refcounts for the old
+   VtsIDs all fell to zero, as expected, and get rid of the old
+   table.  Any failure is serious. */
+static void vts_remap_finish ( void )
+{
+   UWord i, nTab;
+   tl_assert(vts_remap_old_tab != NULL);
+   nTab = VG_(sizeXA)( vts_remap_old_tab );
+   for (i = 0; i < nTab; i++) {
+      VtsTE* te = VG_(indexXA)( vts_remap_old_tab, i );
+      tl_assert(te->vts == NULL);
+      /* This is the assert proper.  Note we're also asserting
+         zeroness for old entries which are unmapped.  That's OK. */
+      tl_assert(te->rc == 0);
+   }
+   VG_(deleteXA)( vts_remap_old_tab );
+   vts_remap_old_tab = NULL;
+}
+
+/* Renumber the VtsIDs of up to MAX_SECMAPS SecMaps, and finish off if
+   that was the last of them. */
+static void vts_remap_step ( UWord max_secmaps )
+{
+   UWord n = 0, secmapW = 0, done;
+   Addr  gaKey;
+   Bool  more = True;
+
+   if (vts_remap_old_tab == NULL)
+      return;
+   done = stats__vts_remap_touched;
+   VG_(initIterAtFM)( map_shmem, vts_remap_next_ga );
+   while (n < max_secmaps) {
+      more = VG_(nextIterFM)( map_shmem, &gaKey, &secmapW );
+      if (!more)
+         break;
+      SecMap* sm = (SecMap*)secmapW;
+      if (sm->vts_gen != vts_tab_gen)
+         vts_remap_SecMap(sm);
+      n++;
+      vts_remap_next_ga = gaKey + N_SECMAP_ARANGE;
+      if (vts_remap_next_ga < gaKey) {
+         /* top of the address space */
+         more = False;
+         break;
+      }
+   }
+   VG_(doneIterFM)( map_shmem );
+   /* Those were not done on lookup, so move them to the other
+      counter. */
+   stats__vts_remap_background += stats__vts_remap_touched - done;
+   stats__vts_remap_touched = done;
+   if (!more)
+      vts_remap_finish();
+}
+
+
 /* NOT TO BE CALLED FROM WITHIN libzsm. */
 __attribute__((noinline))
 static void vts_tab__do_GC ( Bool show_stats )
@@ -2965,6 +3107,11 @@ static void vts_tab__do_GC ( Bool show_stats )
    /* check this is actually necessary. */
    tl_assert(vts_tab_freelist == VtsID_INVALID);
 
+   /* The refcounts are not complete until all the shadow memory has
+      been renumbered after the previous pruning. */
+   vts_remap_step( ~(UWord)0 );
+   tl_assert(vts_remap_old_tab == NULL);
+
    /* empty the caches for partial order checks and binary joins.  We
       could do better and prune out the entries to be deleted, but it
       ain't worth the hassle. */
@@ -3175,6 +3322,11 @@ static void vts_tab__do_GC ( Bool show_stats )
          new_te.vts      = new_vts;
          new_te.rc       = 0;
          new_te.u.freelink = VtsID_INVALID;
+         /* Pruning doesn't invalidate epochs, but it's simpler to
+            drop them.  The threads concerned will re-establish them
+            at their next synchronisation event. */
+         new_te.epoch.thrid = 0;
+         new_te.epoch.tym   = 0;
          Word j = VG_(addToXA)( new_tab, &new_te );
          tl_assert(j <= i);
          tl_assert(j == new_VtsID_ctr - 1);
@@ -3227,30 +3379,18 @@ static void vts_tab__do_GC ( Bool show_stats )
       inc it.  This sets up the new refcounts, and it also gives a
       cheap sanity check of the old ones: all old refcounts should be
       zero after this operation.
-   */
 
-   /* Do the mappings for (a) above: iterate over the Primary shadow
-      mem map (WordFM Addr SecMap*). */
-   UWord secmapW = 0;
-   VG_(initIterFM)( map_shmem );
-   while (VG_(nextIterFM)( map_shmem, NULL, &secmapW )) {
-      UWord   j;
-      SecMap* sm = (SecMap*)secmapW;
-      tl_assert(sm->magic == SecMap_MAGIC);
-      /* Deal with the LineZs */
-      for (i = 0; i < N_SECMAP_ZLINES; i++) {
-         LineZ* lineZ = &sm->linesZ[i];
-         if (lineZ->dict[0] != SVal_INVALID) {
-            for (j = 0; j < 4; j++)
-               remap_VtsIDs_in_SVal(vts_tab, new_tab, &lineZ->dict[j]);
-         } else {
-            LineF* lineF = SVal2Ptr (lineZ->dict[1]);
-            for (j = 0; j < N_LINE_ARANGE; j++)
-               remap_VtsIDs_in_SVal(vts_tab, new_tab, &lineF->w64s[j]);
-         }
-      }
-   }
-   VG_(doneIterFM)( map_shmem );
+      (a) can be a lot of memory, so is not done here.  Instead, the
+      SecMaps are tagged with the vts_tab generation, and renumbered
+      when they are next looked up (and so before any of their
+      SVals are used), or by vts_remap_step, which libhb_maybe_GC
+      calls to do a bounded amount of the work at a time.  The old
+      table is kept until then.  smCache must be flushed, since the
+      SecMaps in it haven't been renumbered. */
+   smCache[0].gaKey = 1;
+   smCache[1].gaKey = 1;
+   smCache[2].gaKey = 1;
+   STATIC_ASSERT (3 == sizeof(smCache)/sizeof(smCache[0]));
 
    /* Do the mappings for (b) above: visit our collection of struct
       _Thrs. */
@@ -3283,21 +3423,15 @@ static void vts_tab__do_GC ( Bool show_stats )
    }
 
    /* So, we're nearly done (with this incredibly complex operation).
-      Check the refcounts for the old VtsIDs all fell to zero, as
-      expected.  Any failure is serious. */
-   for (i = 0; i < nTab; i++) {
-      VtsTE* te = VG_(indexXA)( vts_tab, i );
-      tl_assert(te->vts == NULL);
-      /* This is the assert proper.  Note we're also asserting
-         zeroness for old entries which are unmapped.  That's OK. */
-      tl_assert(te->rc == 0);
-   }
-
-   /* Install the new table and set. */
+      Install the new table and set, keeping the old table for
+      renumbering shadow memory.  vts_remap_finish checks the old
+      refcounts once that is done. */
    VG_(deleteFM)(vts_set, NULL/*kFin*/, NULL/*vFin*/);
    vts_set = new_set;
-   VG_(deleteXA)( vts_tab );
+   vts_remap_old_tab = vts_tab;
    vts_tab = new_tab;
+   vts_tab_gen++;
+   vts_remap_next_ga = 0;
 
    /* The freelist of vts_tab entries is empty now, because we've
       compacted all of the live entries at the low end of the
@@ -3330,7 +3464,8 @@ static void vts_tab__do_GC ( Bool show_stats )
       VtsTE* te = VG_(indexXA)( vts_tab, i );
       tl_assert(te->vts);
       tl_assert(te->vts->id == i);
-      tl_assert(te->rc > 0); /* 'cos we just GC'd */
+      /* .rc may still be zero, for VTSs only referred to from shadow
+         memory which hasn't been renumbered yet. */
       tl_assert(te->u.freelink == VtsID_INVALID); /* in use */
       /* value of te->u.remap  not relevant */
    }
@@ -3366,6 +3501,7 @@ static VTS* temp_max_sized_VTS = NULL;
 //////////////////////////
 static ULong stats__cmpLEQ_queries = 0;
 static ULong stats__cmpLEQ_misses  = 0;
+static ULong stats__cmpLEQ_epochs  = 0;
 static ULong stats__join2_queries  = 0;
 static ULong stats__join2_misses   = 0;
 
@@ -3428,9 +3564,10 @@ static void VtsID__pp ( VtsID vi ) {
 /* compute partial ordering relation of vi1 and vi2. */
 __attribute__((noinline))
 static Bool VtsID__cmpLEQ_WRK ( VtsID vi1, VtsID vi2 ) {
-   UInt hash;
-   Bool leq;
-   VTS  *v1, *v2;
+   UInt   hash;
+   Bool   leq;
+   VTS    *v1, *v2;
+   VtsTE* te1;
    //if (vi1 == vi2) return True;
    tl_assert(vi1 != vi2);
    ////++
@@ -3441,9 +3578,23 @@ static Bool VtsID__cmpLEQ_WRK ( VtsID vi1, VtsID vi2 ) {
       return cmpLEQ_cache[hash].leq;
    stats__cmpLEQ_misses++;
    ////--
-   v1  = VtsID__to_VTS(vi1);
+   te1 = VG_(indexXA)( vts_tab, vi1 );
+   tl_assert(te1->vts);
    v2  = VtsID__to_VTS(vi2);
-   leq = VTS__cmpLEQ( v1, v2 ) == 0;
+   if (te1->epoch.thrid != 0) {
+      /* vi1 is the write clock of thread T at some point, and T's
+         entry in it is te1->epoch.tym.  Then vi1 <= vi2 exactly when
+         vi2's entry for T is at least te1->epoch.tym, since
+         information about T only ever gets to other clocks by T
+         sending its clocks, and T ticks right after each send.  So
+         any vi2 which has seen that much of T has seen all of vi1,
+         and there's no need to compare the rest of the entries. */
+      stats__cmpLEQ_epochs++;
+      leq = VTS__indexAt_ThrID( v2, te1->epoch.thrid ) >= te1->epoch.tym;
+   } else {
+      v1  = te1->vts;
+      leq = VTS__cmpLEQ( v1, v2 ) == 0;
+   }
    ////++
    cmpLEQ_cache[hash].vi1 = vi1;
    cmpLEQ_cache[hash].vi2 = vi2;
@@ -3502,6 +3653,22 @@ static VtsID VtsID__tick ( VtsID vi, Thr* idx ) {
    return vts_tab__find__or__clone_and_add(temp_max_sized_VTS);
 }
 
+/* Record that vi is currently the write clock of thr, so that
+   comparisons against it can be done by epoch (see
+   VtsID__cmpLEQ_WRK). */
+static void VtsID__note_write_clock ( VtsID vi, Thr* thr ) {
+   VtsTE* te;
+   if (!HG_(clo_vts_epochs))
+      return;
+   te = VG_(indexXA)( vts_tab, vi );
+   tl_assert(te->vts);
+   if (te->epoch.thrid == 0) {
+      te->epoch.thrid = Thr__to_ThrID(thr);
+      te->epoch.tym   = VTS__indexAt_ThrID( te->vts, te->epoch.thrid );
+      tl_assert(te->epoch.tym > 0);
+   }
+}
+
 /* index into a VTS (only for assertions) */
 static ULong VtsID__indexAt ( VtsID vi, Thr* idx ) {
    VTS* vts = VtsID__to_VTS(vi);
@@ -4194,24 +4361,29 @@ static inline SVal Ptr2SVal (void* ptr)
       only represent each one once.  The set is indexed/searched by
       ordering on the stack trace vectors.
 
-   2. A Hash table of OldRefs.  These store information about each old
-      ref that we need to record.  Hash table key is the address of the
-      location for which the information is recorded.  For LRU
-      purposes, each OldRef in the hash table is also on a doubly
-      linked list maintaining the order in which the OldRef were most
-      recently accessed.
+   2. A ring of OldRefs.  These store information about each old
+      ref that we need to record.  The ring is made of segments of
+      OLDREF_SEG_SIZE OldRefs, and OldRefs are referred to by their
+      index in it.  A hash table, keyed by the address of the location
+      for which the information is recorded, gives the index of the
+      first OldRef of a chain, the rest being linked through the
+      ht_next indices.
       Each OldRef also maintains the stamp at which it was last accessed.
       With these stamps, we can quickly check which of 2 OldRef is the
-      'newest', without having to scan the full list of LRU OldRef.
+      'newest'.
 
       The important part of an OldRef is, however, its acc component.
       This binds a TSW triple (thread, size, R/W) to an RCEC.
 
-      We allocate a maximum of VG_(clo_conflict_cache_size) OldRef.
-      Then we do exact LRU discarding.  For each discarded OldRef we must
-      of course decrement the reference count on the RCEC it
-      refers to, in order that entries from (1) eventually get
-      discarded too.
+      The ring holds at least VG_(clo_conflict_cache_size) OldRefs.
+      New OldRefs are created at oldref_head, which goes round the
+      ring, so the OldRef created longest ago is the one discarded:
+      replacement is FIFO rather than LRU.  An OldRef which is accessed
+      again once it is in the older half of the ring is moved to the
+      head, so that locations still in use are not lost.  For each
+      discarded OldRef we must of course decrement the reference count
+      on the RCEC it refers to, in order that entries from (1)
+      eventually get discarded too.
 */
 
 static UWord stats__evm__lookup_found = 0;
@@ -4423,10 +4595,11 @@ static RCEC* get_RCEC ( Thr* thr )
 
 ///////////////////////////////////////////////////////
 //// Part (2):
-///  A hashtable guest-addr -> OldRef, that refers to (1)
+///  A ring of OldRefs, that refer to (1), and a hashtable guest-addr
+///  -> OldRef to find them.
 ///  Note: we use the guest address as key. This means that the entries
 ///  for multiple threads accessing the same address will land in the same
-///  bucket. It might be nice to have a better distribution of the
+///  chain. It might be nice to have a better distribution of the
 ///  OldRef in the hashtable by using ask key the guestaddress ^ tsw.
 ///  The problem is that when a race is reported on a ga, we need to retrieve
 ///  efficiently the accesses to ga by other threads, only using the ga.
@@ -4436,7 +4609,7 @@ static RCEC* get_RCEC ( Thr* thr )
    number of held locks. The size (1,2,4,8) is stored as is in szB.
    Note that szB uses more bits than needed to store a size up to 8.
    This allows to use a TSW as a fully initialised UInt e.g. in
-   cmp_oldref_tsw. If needed, a more compact representation of szB
+   tsw_as_UInt. If needed, a more compact representation of szB
    can be done (e.g. use only 4 bits, or use only 2 bits and encode the
    size (1,2,4,8) as 00 = 1, 01 = 2, 10 = 4, 11 = 8. */
 typedef 
@@ -4453,104 +4626,159 @@ typedef
    }
    Thr_n_RCEC;
 
+/* OldRefs are not individually allocated, and are not linked to each
+   other with pointers: they live in a ring of fixed size segments, and
+   refer to each other by their index in the ring.  This makes an
+   OldRef 32 bytes on a 64 bit platform.  An OldRef with acc.tsw.thrid
+   == 0 is an unused slot. */
 typedef
-   struct OldRef {
-      struct OldRef *ht_next; // to link hash table nodes together.
-      UWord  ga; // hash_table key, == address for which we record an access.
-      struct OldRef *prev; // to refs older than this one
-      struct OldRef *next; // to refs newer that this one
-      UWord stamp; // allows to order (by time of access) 2 OldRef
+   struct {
+      Addr       ga;      // address for which we record an access.
       Thr_n_RCEC acc;
+      UInt       ht_next; // index of the next OldRef in the same chain.
+      UInt       stamp;   // allows to order (by time of access) 2 OldRef
    }
    OldRef;
 
-/* Returns the or->tsw as an UInt */
-static inline UInt oldref_tsw (const OldRef* or)
+/* Returns the tsw as an UInt */
+static inline UInt tsw_as_UInt (TSW tsw)
+{
+   return *(const UInt*)(&tsw);
+}
+
+/* The ring.  Index 0 is never used, so that 0 can denote 'no OldRef'
+   in the hashtable chains.  oldref_segs has oldref_n_segs entries, of
+   which the first oldref_segs_used have been allocated: the segments
+   are only allocated when oldref_head first reaches them.
+   New OldRefs are always created at oldref_head, replacing the
+   OldRef that was created longest ago, if any.  So the ring is a FIFO
+   rather than an LRU cache.  To avoid discarding information about
+   locations that are still being accessed, an OldRef that is accessed
+   again once it is in the older half of the ring is moved to the head
+   (see event_map_bind). */
+#define OLDREF_SEG_BITS 12
+#define OLDREF_SEG_SIZE (1 << OLDREF_SEG_BITS)
+
+static OldRef** oldref_segs      = NULL;
+static UInt     oldref_n_segs    = 0;
+static UInt     oldref_segs_used = 0;
+static UInt     oldref_ring_size = 0; /* == oldref_n_segs * OLDREF_SEG_SIZE */
+static UInt     oldref_head      = 1; /* next OldRef to (re-)use */
+static UWord    oldrefs_used     = 0; /* # OldRefs in use */
+
+static UWord stats__oldref_moves = 0;
+static UWord stats__oldref_discards = 0;
+static UWord stats__oldrefHT_grows = 0;
+
+static inline OldRef* OldRef_at ( UInt ix )
 {
-   return *(const UInt*)(&or->acc.tsw);
+   return &oldref_segs[ix >> OLDREF_SEG_BITS][ix & (OLDREF_SEG_SIZE - 1)];
 }
 
-/* Compare the tsw component for 2 OldRef.
-   Used for OldRef hashtable (which already verifies equality of the
-   'key' part. */
-static Word cmp_oldref_tsw (const void* node1, const void* node2 )
+/* Returns the nr of OldRefs created since the one at ix, i.e. 0 for
+   the newest one. */
+static inline UInt OldRef_age ( UInt ix )
 {
-   const UInt tsw1 = oldref_tsw(node1);
-   const UInt tsw2 = oldref_tsw(node2);
-
-   if (tsw1 < tsw2) return -1;
-   if (tsw1 > tsw2) return  1;
-   return 0;
+   return ix < oldref_head
+      ? oldref_head - 1 - ix
+      : oldref_head - 1 - ix + (oldref_ring_size - 1);
 }
 
+/* Hash table guest-addr -> chain of OldRefs, linked by ht_next.
+   Contains all the OldRefs in use.  The table is doubled in size when
+   the average chain length becomes bigger than 2, until it has about
+   half as many chains as there are OldRefs in the ring. */
+static UInt* oldrefHT      = NULL;
+static UInt  oldrefHT_bits = 0;
 
-//////////// BEGIN OldRef pool allocator
-static PoolAlloc* oldref_pool_allocator;
-// Note: We only allocate elements in this pool allocator, we never free them.
-// We stop allocating elements at VG_(clo_conflict_cache_size).
-//////////// END OldRef pool allocator
-
-static OldRef mru; 
-static OldRef lru; 
-// A double linked list, chaining all OldREf in a mru/lru order.
-// mru/lru are sentinel nodes.
-// Whenever an oldref is re-used, its position is changed as the most recently
-// used (i.e. pointed to by mru.prev).
-// When a new oldref is needed, it is allocated from the pool
-//  if we have not yet reached --conflict-cache-size.
-// Otherwise, if all oldref have already been allocated,
-// the least recently used (i.e. pointed to by lru.next) is re-used.
-// When an OldRef is used, it is moved as the most recently used entry
-// (i.e. pointed to by mru.prev).
-
-// Removes r from the double linked list
-// Note: we do not need to test for special cases such as
-// NULL next or prev pointers, because we have sentinel nodes
-// at both sides of the list. So, a node is always forward and
-// backward linked.
-static inline void OldRef_unchain(OldRef *r)
+static inline UInt oldrefHT_hash ( Addr ga )
 {
-   r->next->prev = r->prev;
-   r->prev->next = r->next;
+   return (UInt)(((ULong)ga * 0x9E3779B97F4A7C15ULL) >> (64 - oldrefHT_bits));
 }
 
-// Insert new as the newest OldRef
-// Similarly to OldRef_unchain, no need to test for NULL
-// pointers, as e.g. mru.prev is always guaranteed to point
-// to a non NULL node (lru when the list is empty).
-static inline void OldRef_newest(OldRef *new)
+static void OldRef_link ( UInt ix )
 {
-   new->next = &mru;
-   new->prev = mru.prev;
-   mru.prev = new;
-   new->prev->next = new;
+   OldRef* ref = OldRef_at(ix);
+   UInt    h   = oldrefHT_hash(ref->ga);
+   ref->ht_next = oldrefHT[h];
+   oldrefHT[h] = ix;
+   oldrefs_used++;
 }
 
+static void OldRef_unlink ( UInt ix )
+{
+   UInt* p = &oldrefHT[oldrefHT_hash(OldRef_at(ix)->ga)];
+   while (*p != ix) {
+      tl_assert(*p != 0);
+      p = &OldRef_at(*p)->ht_next;
+   }
+   *p = OldRef_at(ix)->ht_next;
+   tl_assert(oldrefs_used > 0);
+   oldrefs_used--;
+}
 
-static VgHashTable* oldrefHT    = NULL; /* Hash table* OldRef* */
-static UWord     oldrefHTN    = 0;    /* # elems in oldrefHT */
-/* Note: the nr of ref in the oldrefHT will always be equal to
-   the nr of elements that were allocated from the OldRef pool allocator
-   as we never free an OldRef : we just re-use them. */
+/* Returns the index of the OldRef for (ga, tsw), or 0 if there is
+   none. */
+static UInt OldRef_find ( Addr ga, TSW tsw )
+{
+   UInt ix;
+   for (ix = oldrefHT[oldrefHT_hash(ga)]; ix; ix = OldRef_at(ix)->ht_next) {
+      const OldRef* ref = OldRef_at(ix);
+      if (ref->ga == ga && tsw_as_UInt(ref->acc.tsw) == tsw_as_UInt(tsw))
+         return ix;
+   }
+   return 0;
+}
 
+static void oldrefHT_grow ( void )
+{
+   UInt s, i;
+
+   HG_(free)(oldrefHT);
+   oldrefHT_bits++;
+   oldrefHT = HG_(zalloc)("libhb.oldrefHT_grow (oldref hashtable)",
+                          (1 << oldrefHT_bits) * sizeof(UInt));
+   oldrefs_used = 0;
+   for (s = 0; s < oldref_segs_used; s++) {
+      for (i = 0; i < OLDREF_SEG_SIZE; i++) {
+         UInt ix = s * OLDREF_SEG_SIZE + i;
+         if (ix != 0 && OldRef_at(ix)->acc.tsw.thrid != 0)
+            OldRef_link(ix);
+      }
+   }
+   stats__oldrefHT_grows++;
+}
 
-/* allocates a new OldRef or re-use the lru one if all allowed OldRef
-   have already been allocated. */
-static OldRef* alloc_or_reuse_OldRef ( void )
+/* Returns the index of an unused OldRef at the head of the ring,
+   discarding the OldRef that was there if needed.  The caller must
+   fill it in and then OldRef_link it. */
+static UInt OldRef_alloc ( void )
 {
-   if (oldrefHTN < HG_(clo_conflict_cache_size)) {
-      oldrefHTN++;
-      return VG_(allocEltPA) ( oldref_pool_allocator );
-   } else {
-      OldRef *oldref_ht;
-      OldRef *oldref = lru.next;
+   UInt    ix = oldref_head;
+   OldRef* ref;
 
-      OldRef_unchain(oldref);
-      oldref_ht = VG_(HT_gen_remove) (oldrefHT, oldref, cmp_oldref_tsw);
-      tl_assert (oldref == oldref_ht);
-      ctxt__rcdec( oldref->acc.rcec );
-      return oldref;
+   if (oldref_segs[ix >> OLDREF_SEG_BITS] == NULL) {
+      tl_assert(ix >> OLDREF_SEG_BITS == oldref_segs_used);
+      oldref_segs[ix >> OLDREF_SEG_BITS]
+         = HG_(zalloc)("libhb.OldRef_alloc (OldRef segment)",
+                       OLDREF_SEG_SIZE * sizeof(OldRef));
+      oldref_segs_used++;
    }
+   ref = OldRef_at(ix);
+   if (ref->acc.tsw.thrid != 0) {
+      OldRef_unlink(ix);
+      ctxt__rcdec( ref->acc.rcec );
+      ref->acc.tsw.thrid = 0;
+      stats__oldref_discards++;
+   }
+
+   oldref_head = ix + 1 == oldref_ring_size ? 1 : ix + 1;
+
+   if (oldrefs_used >= (2U << oldrefHT_bits)
+       && (2U << oldrefHT_bits) < oldref_ring_size)
+      oldrefHT_grow();
+
+   return ix;
 }
 
 
@@ -4577,13 +4805,17 @@ static inline Word cmp_nonempty_intervals ( Addr a1, SizeT n1,
    return 0;
 }
 
-static UWord event_map_stamp = 0; // Used to stamp each OldRef when touched.
+/* Used to stamp each OldRef when touched.  Only the difference between
+   two stamps is meaningful: for long running applications,
+   event_map_stamp will cycle. */
+static UInt event_map_stamp = 0;
 
 static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
 {
-   OldRef  example;
    OldRef* ref;
+   UInt    ix;
    RCEC*   rcec;
+   TSW     tsw;
 
    tl_assert(thr);
    ThrID thrid = thr->thrid;
@@ -4599,15 +4831,15 @@ static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
 
    /* Look in the oldrefHT to see if we already have a record for this
       address/thr/sz/isW. */
-   example.ga = a;
-   example.acc.tsw = (TSW) {.thrid = thrid,
-                            .szB = szB,
-                            .isW = (UInt)(isW & 1)};
-   ref = VG_(HT_gen_lookup) (oldrefHT, &example, cmp_oldref_tsw);
+   tsw = (TSW) {.thrid = thrid,
+                .szB = szB,
+                .isW = (UInt)(isW & 1)};
+   ix = OldRef_find(a, tsw);
 
-   if (ref) {
+   if (ix) {
       /* We already have a record for this address and this (thrid, R/W,
          size) triple. */
+      ref = OldRef_at(ix);
       tl_assert (ref->ga == a);
 
       /* thread 'thr' has an entry.  Update its RCEC, if it differs. */
@@ -4620,28 +4852,37 @@ static void event_map_bind ( Addr a, SizeT szB, Bool isW, Thr* thr )
          ref->acc.rcec       = rcec;
       }
       tl_assert(ref->acc.tsw.thrid == thrid);
-      /* Update the stamp, RCEC and the W-held lockset. */
+
+      /* If the record is in the older half of the ring, move it to the
+         head so that it is not discarded soon, as it is still in use. */
+      if (UNLIKELY(OldRef_age(ix) >= oldref_ring_size / 2)) {
+         OldRef moved = *ref;
+         OldRef_unlink(ix);
+         ref->acc.tsw.thrid = 0;
+         ix = OldRef_alloc();
+         ref = OldRef_at(ix);
+         *ref = moved;
+         OldRef_link(ix);
+         stats__oldref_moves++;
+      }
+
+      /* Update the stamp and the W-held lockset. */
       ref->stamp = event_map_stamp;
       ref->acc.locksHeldW = locksHeldW;
 
-      OldRef_unchain(ref);
-      OldRef_newest(ref);
-
    } else {
       /* We don't have a record for this address+triple.  Create a new one. */
       stats__ctxt_neq_tsw_neq_rcec++;
-      ref = alloc_or_reuse_OldRef();
+      ix = OldRef_alloc();
+      ref = OldRef_at(ix);
       ref->ga = a;
-      ref->acc.tsw = (TSW) {.thrid  = thrid,
-                            .szB    = szB,
-                            .isW    = (UInt)(isW & 1)};
+      ref->acc.tsw = tsw;
       ref->stamp = event_map_stamp;
       ref->acc.locksHeldW = locksHeldW;
       ref->acc.rcec       = rcec;
       ctxt__rcinc(rcec);
 
-      VG_(HT_add_node) ( oldrefHT, ref );
-      OldRef_newest (ref);
+      OldRef_link(ix);
    }
    event_map_stamp++;
 }
@@ -4660,6 +4901,7 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
    OldRef *ref = NULL;
    SizeT  ref_szB = 0;
 
+   UInt   cand_ix;
    OldRef *cand_ref;
    SizeT  cand_ref_szB;
    Addr   cand_a;
@@ -4689,11 +4931,12 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
       /* Find the first HT element for this address.
          We might have several of these. They will be linked via ht_next.
          We however need to check various elements as the list contains
-         all elements that map to the same bucket. */
-      for (cand_ref = VG_(HT_lookup)( oldrefHT, cand_a ); 
-           cand_ref; cand_ref = cand_ref->ht_next) {
+         all elements that map to the same chain. */
+      for (cand_ix = oldrefHT[oldrefHT_hash(cand_a)];
+           cand_ix; cand_ix = cand_ref->ht_next) {
+         cand_ref = OldRef_at(cand_ix);
          if (cand_ref->ga != cand_a)
-            /* OldRef for another address in this HT bucket. Ignore. */
+            /* OldRef for another address in this chain. Ignore. */
             continue;
 
          if (cand_ref->acc.tsw.thrid == thrid)
@@ -4712,7 +4955,7 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
             continue;
 
          /* We have a match. Keep this match if it is newer than
-            the previous match. Note that stamp are Unsigned Words, and
+            the previous match. Note that stamp are UInts, and
             for long running applications, event_map_stamp might have cycled.
             So, 'roll' each stamp using event_map_stamp to have the
             stamps in the good order, in case event_map_stamp recycled. */
@@ -4758,30 +5001,34 @@ Bool libhb_event_map_lookup ( /*OUT*/ExeContext** resEC,
 
 void libhb_event_map_access_history ( Addr a, SizeT szB, Access_t fn )
 {
-   OldRef *ref = lru.next;
+   UInt ix, k;
    SizeT ref_szB;
    Int n;
-      
-   while (ref != &mru) {
-      ref_szB = ref->acc.tsw.szB;
-      if (cmp_nonempty_intervals(a, szB, ref->ga, ref_szB) == 0) {
-         RCEC* ref_rcec = ref->acc.rcec;
-         for (n = 0; n < N_FRAMES; n++) {
-            if (0 == ref_rcec->frames[n]) {
-               break;
+
+   /* Visit the OldRefs in the order they were (re-)created, oldest
+      first. */
+   ix = oldref_head;
+   for (k = 1; k < oldref_ring_size; k++) {
+      if ((ix >> OLDREF_SEG_BITS) < oldref_segs_used
+          && OldRef_at(ix)->acc.tsw.thrid != 0) {
+         OldRef* ref = OldRef_at(ix);
+         ref_szB = ref->acc.tsw.szB;
+         if (cmp_nonempty_intervals(a, szB, ref->ga, ref_szB) == 0) {
+            RCEC* ref_rcec = ref->acc.rcec;
+            for (n = 0; n < N_FRAMES; n++) {
+               if (0 == ref_rcec->frames[n]) {
+                  break;
+               }
             }
+            (*fn)(ref_rcec->frames, n,
+                  Thr__from_ThrID(ref->acc.tsw.thrid),
+                  ref->ga,
+                  ref_szB,
+                  ref->acc.tsw.isW,
+                  ref->acc.locksHeldW);
          }
-         (*fn)(ref_rcec->frames, n,
-               Thr__from_ThrID(ref->acc.tsw.thrid),
-               ref->ga,
-               ref_szB,
-               ref->acc.tsw.isW,
-               ref->acc.locksHeldW);
       }
-      tl_assert (ref->next == &mru
-                 || ((ref->stamp - event_map_stamp)
-                        < ref->next->stamp - event_map_stamp));
-      ref = ref->next;
+      ix = ix + 1 == oldref_ring_size ? 1 : ix + 1;
    }
 }
 
@@ -4805,30 +5052,23 @@ static void event_map_init ( void )
    for (i = 0; i < N_RCEC_TAB; i++)
       contextTab[i] = NULL;
 
-   /* Oldref pool allocator */
-   oldref_pool_allocator = VG_(newPA)(
-                               sizeof(OldRef),
-                               1000 /* OldRefs per pool */,
-                               HG_(zalloc),
-                               "libhb.event_map_init.3 (OldRef pools)",
-                               HG_(free)
-                            );
+   /* Oldref ring.  Round up the size so as to have at least
+      --conflict-cache-size usable OldRefs, slot 0 being unused. */
+   tl_assert(!oldref_segs);
+   oldref_n_segs = (HG_(clo_conflict_cache_size) + OLDREF_SEG_SIZE)
+                   / OLDREF_SEG_SIZE;
+   oldref_ring_size = oldref_n_segs * OLDREF_SEG_SIZE;
+   oldref_segs = HG_(zalloc)( "libhb.event_map_init.3 (OldRef segments)",
+                              oldref_n_segs * sizeof(OldRef*) );
+   oldref_segs_used = 0;
+   oldref_head = 1;
 
    /* Oldref hashtable */
    tl_assert(!oldrefHT);
-   oldrefHT = VG_(HT_construct) ("libhb.event_map_init.4 (oldref hashtable)");
-
-   oldrefHTN = 0;
-   mru.prev = &lru;
-   mru.next = NULL;
-   lru.prev = NULL;
-   lru.next = &mru;
-   mru.acc = (Thr_n_RCEC) {.tsw = {.thrid = 0, 
-                                   .szB = 0, 
-                                   .isW = 0},
-                           .locksHeldW = 0, 
-                           .rcec = NULL};
-   lru.acc = mru.acc;
+   oldrefHT_bits = 12;
+   oldrefHT = HG_(zalloc)( "libhb.event_map_init.4 (oldref hashtable)",
+                           (1 << oldrefHT_bits) * sizeof(UInt) );
+   oldrefs_used = 0;
 }
 
 static void event_map__check_reference_counts ( void )
@@ -4836,6 +5076,7 @@ static void event_map__check_reference_counts ( void )
    RCEC*   rcec;
    OldRef* oldref;
    Word    i;
+   UInt    s, j;
    UWord   nEnts = 0;
 
    /* Set the 'check' reference counts to zero.  Also, optionally
@@ -4857,15 +5098,23 @@ static void event_map__check_reference_counts ( void )
    tl_assert(stats__ctxt_tab_curr <= stats__ctxt_tab_max);
 
    /* visit all the referencing points, inc check ref counts */
-   VG_(HT_ResetIter)( oldrefHT );
-   oldref = VG_(HT_Next)( oldrefHT );
-   while (oldref) {
-      tl_assert (oldref->acc.tsw.thrid);
-      tl_assert (oldref->acc.rcec);
-      tl_assert (oldref->acc.rcec->magic == RCEC_MAGIC);
-      oldref->acc.rcec->rcX++;
-      oldref = VG_(HT_Next)( oldrefHT );
+   nEnts = 0;
+   for (s = 0; s < oldref_segs_used; s++) {
+      for (j = 0; j < OLDREF_SEG_SIZE; j++) {
+         if (s == 0 && j == 0)
+            continue;
+         oldref = OldRef_at(s * OLDREF_SEG_SIZE + j);
+         if (oldref->acc.tsw.thrid == 0)
+            continue;
+         tl_assert (oldref->acc.rcec);
+         tl_assert (oldref->acc.rcec->magic == RCEC_MAGIC);
+         tl_assert (OldRef_find(oldref->ga, oldref->acc.tsw)
+                    == s * OLDREF_SEG_SIZE + j);
+         oldref->acc.rcec->rcX++;
+         nEnts++;
+      }
    }
+   tl_assert(nEnts == oldrefs_used);
 
    /* compare check ref counts with actual */
    for (i = 0; i < N_RCEC_TAB; i++) {
@@ -6271,6 +6520,7 @@ Thr* libhb_init (
    thr->viW = vi;
    VtsID__rcinc(thr->viR);
    VtsID__rcinc(thr->viW);
+   VtsID__note_write_clock(thr->viW, thr);
 
    show_thread_state("  root", thr);
    return thr;
@@ -6290,6 +6540,7 @@ Thr* libhb_create ( Thr* parent )
    Filter__clear(child->filter, "libhb_create(child)");
    VtsID__rcinc(child->viR);
    VtsID__rcinc(child->viW);
+   VtsID__note_write_clock(child->viW, child);
    /* We need to do note_local_Kw_n_stack_for( child ), but it's too
       early for that - it may not have a valid TId yet.  So, let
       libhb_Thr_resumes pick it up the first time the thread runs. */
@@ -6305,6 +6556,7 @@ Thr* libhb_create ( Thr* parent )
    Filter__clear(parent->filter, "libhb_create(parent)");
    VtsID__rcinc(parent->viR);
    VtsID__rcinc(parent->viW);
+   VtsID__note_write_clock(parent->viW, parent);
    note_local_Kw_n_stack_for( parent );
 
    show_thread_state(" child", child);
@@ -6397,8 +6649,10 @@ void libhb_shutdown ( Bool show_stats )
                   stats__msmcread, stats__msmcread_change);
       VG_(printf)("   libhb: %'13llu msmcwrite (%'llu dragovers)\n",
                   stats__msmcwrite, stats__msmcwrite_change);
-      VG_(printf)("   libhb: %'13llu cmpLEQ queries (%'llu misses)\n",
-                  stats__cmpLEQ_queries, stats__cmpLEQ_misses);
+      VG_(printf)("   libhb: %'13llu cmpLEQ queries (%'llu misses,"
+                  " %'llu by epoch)\n",
+                  stats__cmpLEQ_queries, stats__cmpLEQ_misses,
+                  stats__cmpLEQ_epochs);
       VG_(printf)("   libhb: %'13llu join2  queries (%'llu misses)\n",
                   stats__join2_queries, stats__join2_misses);
 
@@ -6420,6 +6674,11 @@ void libhb_shutdown ( Bool show_stats )
       );
       VG_(printf)("   libhb: #%lu vts_tab GC    #%lu vts pruning\n",
                   stats__vts_tab_GC, stats__vts_pruning);
+      VG_(printf)("   libhb: vts_tab GC pauses: %'lu ms total, %'lu ms max\n",
+                  stats__vts_GC_ms_total, stats__vts_GC_ms_max);
+      VG_(printf)("   libhb: SecMaps renumbered after pruning: "
+                  "%'lu on lookup, %'lu in background\n",
+                  stats__vts_remap_touched, stats__vts_remap_background);
       VG_(printf)( "   libhb: %lu entries in vts_set\n",
                    VG_(sizeFM)( vts_set ) );
 
@@ -6459,13 +6718,16 @@ void libhb_shutdown ( Bool show_stats )
       }
 
       VG_(printf)("%s","\n");
-      VG_(printf)( "   libhb: oldrefHTN %lu (%'d bytes)\n",
-                   oldrefHTN, (int)(oldrefHTN * sizeof(OldRef)));
-      tl_assert (oldrefHTN == VG_(HT_count_nodes) (oldrefHT));
+      VG_(printf)( "   libhb: oldrefs %lu in use, %u of %u segments"
+                   " allocated (%'lu bytes)\n",
+                   oldrefs_used, oldref_segs_used, oldref_n_segs,
+                   (UWord)oldref_segs_used * OLDREF_SEG_SIZE * sizeof(OldRef));
+      VG_(printf)( "   libhb: oldrefs discarded %'lu, moved to ring head %'lu\n",
+                   stats__oldref_discards, stats__oldref_moves);
+      VG_(printf)( "   libhb: oldrefHT %u chains (%lu grows)\n",
+                   1U << oldrefHT_bits, stats__oldrefHT_grows);
       VG_(printf)( "   libhb: oldref lookup found=%lu notfound=%lu\n",
                    stats__evm__lookup_found, stats__evm__lookup_notfound);
-      if (VG_(clo_verbosity) > 1)
-         VG_(HT_print_stats) (oldrefHT, cmp_oldref_tsw);
       VG_(printf)( "   libhb: oldref bind tsw/rcec "
                    "==/==:%'lu ==/!=:%'lu !=/!=:%'lu\n",
                    stats__ctxt_eq_tsw_eq_rcec, stats__ctxt_eq_tsw_neq_rcec,
@@ -6653,6 +6915,7 @@ void libhb_so_send ( Thr* thr, SO* so, Bool strong_send )
    }
    VtsID__rcinc(thr->viR);
    VtsID__rcinc(thr->viW);
+   VtsID__note_write_clock(thr->viW, thr);
 
    if (strong_send)
       show_thread_state("s-send", thr);
@@ -6691,6 +6954,7 @@ void libhb_so_recv ( Thr* thr, SO* so, Bool strong_recv )
          VtsID__rcdec(thr->viW);
          thr->viW = VtsID__join2( thr->viW, so->viW );
          VtsID__rcinc(thr->viW);
+         VtsID__note_write_clock(thr->viW, thr);
 
          /* See comment just above, re r10589. */
          //VtsID__rcdec(thr->viW);
@@ -7070,8 +7334,19 @@ void libhb_maybe_GC ( void )
       and we hit the threshold point, then do a GC */
    Bool vts_tab_GC = vts_tab_freelist == VtsID_INVALID
       && VG_(sizeXA)( vts_tab ) >= vts_next_GC_at;
-   if (UNLIKELY (vts_tab_GC))
+   if (UNLIKELY (vts_tab_GC)) {
+      UWord t0 = VG_(read_millisecond_timer)();
       vts_tab__do_GC( False/*don't show stats*/ );
+      UWord ms = VG_(read_millisecond_timer)() - t0;
+      stats__vts_GC_ms_total += ms;
+      if (ms > stats__vts_GC_ms_max)
+         stats__vts_GC_ms_max = ms;
+   }
+
+   /* Carry on renumbering shadow memory after a VTS pruning, a
+      bounded amount at a time. */
+   if (UNLIKELY(vts_remap_old_tab != NULL))
+      vts_remap_step( VTS_REMAP_STEP_SECMAPS );
 
    /* scan GC the SecMaps when
           (1) no SecMap in the freelist
@@ -0,0 +1,58 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* To be run with --history-level=full --conflict-cache-size=10000.
+   The child makes many more distinct accesses than fit in the
+   conflict cache, but keeps writing x from the same place every now
+   and then.  The stack of that write must still be reported for the
+   race with the parent, whereas older records get discarded.  The
+   child takes a private lock before each write of x, so that its
+   clock moves on and the write is recorded again, rather than
+   filtered out as a repeat of the previous one. */
+
+int x = 0;
+
+#define N_ARR 50000
+int arr[N_ARR];
+
+pthread_mutex_t child_mx = PTHREAD_MUTEX_INITIALIZER;
+
+void touch_x ( int i )
+{
+   x = i;
+}
+
+void* child_fn ( void* arg )
+{
+   int i;
+   for (i = 0; i < N_ARR; i++) {
+      if (i % 5000 == 0) {
+         pthread_mutex_lock(&child_mx);
+         pthread_mutex_unlock(&child_mx);
+         touch_x(i);
+      }
+      arr[i] = i;
+   }
+   return NULL;
+}
+
+int main ( void )
+{
+   const struct timespec delay = { 0, 500 * 1000 * 1000 };
+   pthread_t child;
+   if (pthread_create(&child, NULL, child_fn, NULL)) {
+      perror("pthread_create");
+      exit(1);
+   }
+   nanosleep(&delay, 0);
+   /* Unprotected relative to child */
+   x = -1;
+
+   if (pthread_join(child, NULL)) {
+      perror("pthread join");
+      exit(1);
+   }
+
+   return 0;
+}
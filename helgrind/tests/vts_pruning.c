@@ -0,0 +1,72 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Race-free program which runs many short-lived threads, so that the
+   VTS table is garbage collected and pruned a number of times while
+   shadow memory still refers to the clocks of dead threads.  To be
+   run with --vts-pruning=always.  Each thread takes a lock many times,
+   creating lots of VTSs, and writes its own slice of a buffer big
+   enough to be spread over many SecMaps, which must then be renumbered
+   after each pruning.  The main thread reads the whole buffer after
+   joining the threads. */
+
+#define N_ROUNDS   20
+#define N_THREADS  4
+#define N_LOCKS    200
+#define SLICE      (256 * 1024)
+
+static pthread_mutex_t mx = PTHREAD_MUTEX_INITIALIZER;
+static long counter = 0;
+static unsigned char* buf;
+
+static void* child_fn ( void* arg )
+{
+   long me = (long)arg;
+   unsigned char* slice = buf + me * SLICE;
+   int i;
+
+   for (i = 0; i < N_LOCKS; i++) {
+      pthread_mutex_lock(&mx);
+      counter++;
+      pthread_mutex_unlock(&mx);
+      slice[(i * 1237) % SLICE] += i;
+   }
+   for (i = 0; i < SLICE; i += 4096)
+      slice[i]++;
+   return NULL;
+}
+
+int main ( void )
+{
+   pthread_t thr[N_THREADS];
+   unsigned long sum = 0;
+   long r, t;
+
+   buf = calloc(N_THREADS, SLICE);
+   if (buf == NULL) {
+      perror("calloc");
+      exit(1);
+   }
+
+   for (r = 0; r < N_ROUNDS; r++) {
+      for (t = 0; t < N_THREADS; t++) {
+         if (pthread_create(&thr[t], NULL, child_fn, (void*)t)) {
+            perror("pthread_create");
+            exit(1);
+         }
+      }
+      for (t = 0; t < N_THREADS; t++) {
+         if (pthread_join(thr[t], NULL)) {
+            perror("pthread_join");
+            exit(1);
+         }
+      }
+      for (t = 0; t < N_THREADS * SLICE; t += 4096)
+         sum += buf[t];
+   }
+
+   printf("counter %ld, sum %lu\n", counter, sum);
+   free(buf);
+   return 0;
+}
@@ -1282,6 +1282,12 @@ struct  vki_seminfo {
 #define VKI_MREMAP_MAYMOVE	1
 #define VKI_MREMAP_FIXED	2
 
+//----------------------------------------------------------------------
+// From linux-2.6.38/include/asm-generic/mman-common.h
+//----------------------------------------------------------------------
+
+#define VKI_MADV_HUGEPAGE	14	/* Worth backing with hugepages */
+
 //----------------------------------------------------------------------
 // From linux-2.6.31-rc4/include/linux/futex.h
 //----------------------------------------------------------------------
@@ -134,6 +134,13 @@ extern VgHashTable *MC_(mempool_list);
 
 /* Shadow memory functions */
 Bool MC_(check_mem_is_noaccess)( Addr a, SizeT len, Addr* bad_addr );
+
+/* Every so many calls, run an incremental deduplication pass over
+   the shadow memory, if --dedup-secmaps=yes.  Must not be called while
+   a pointer to a secondary map may be live, e.g. from inside the
+   functions below. */
+void MC_(maybe_dedup_secmaps)      ( void );
+
 void MC_(make_mem_noaccess)        ( Addr a, SizeT len );
 void MC_(make_mem_undefined_w_otag)( Addr a, SizeT len, UInt otag );
 void MC_(make_mem_defined)         ( Addr a, SizeT len );
@@ -710,6 +717,14 @@ extern Bool MC_(clo_show_mismatched_frees);
    operations? Default: NO */
 extern Bool MC_(clo_expensive_definedness_checks);
 
+/* Should identical shadow memory secondary maps be merged into shared
+   copies?  Default: NO */
+extern Bool MC_(clo_dedup_secmaps);
+
+/* Should the common cases of 32 and 64 bit shadow loads and stores be
+   done by inline code rather than helper calls?  Default: NO */
+extern Bool MC_(clo_inline_loadv);
+
 /*------------------------------------------------------------*/
 /*--- Instrumentation                                      ---*/
 /*------------------------------------------------------------*/
@@ -755,6 +770,11 @@ VG_REGPARM(1) UWord MC_(helperc_LOADV16be)  ( Addr );
 VG_REGPARM(1) UWord MC_(helperc_LOADV16le)  ( Addr );
 VG_REGPARM(1) UWord MC_(helperc_LOADV8)     ( Addr );
 
+/* For generating inline versions of the LOADV/STOREV fast paths */
+Addr  MC_(inline_primary_map)       ( void );
+UWord MC_(inline_primary_map_mask)  ( void );
+UWord MC_(inline_fast_access_mask)  ( Int szB );
+
 VG_REGPARM(3)
 void MC_(helperc_MAKE_STACK_UNINIT_w_o) ( Addr base, UWord len, Addr nia );
 
@@ -457,6 +457,23 @@ static MC_Chunk** lc_chunks;
 // How many chunks we're dealing with.
 static Int        lc_n_chunks;
 static SizeT lc_chunks_n_frees_marker;
+// The range of addresses covered by the blocks in lc_chunks, ie. from
+// the start of the first block up to the end of the last one.  A word
+// outside this range cannot point to a block, which lets the mark phase
+// reject most non-pointer words without asking the address space manager
+// or searching lc_chunks.
+static Addr lc_chunks_min_addr;
+static Addr lc_chunks_max_addr;
+// A direct index into lc_chunks, built together with it.  The range
+// [lc_chunks_min_addr, lc_chunks_max_addr) is cut into granules of
+// (1 << lc_chunk_index_shift) bytes.  lc_chunk_index[g] is the number
+// of the first block ending after the start of granule g, so a block
+// containing an address in granule g is one of lc_chunk_index[g] ..
+// lc_chunk_index[g+1].  This replaces a binary search over all of
+// lc_chunks (tens of millions of entries, in the worst case) with one
+// over the few blocks in a granule.
+static Int*  lc_chunk_index;
+static UInt  lc_chunk_index_shift;
 // This has the same number of entries as lc_chunks, and each entry
 // in lc_chunks corresponds with the entry here (ie. lc_chunks[i] and
 // lc_extras[i] describe the same block).
@@ -519,6 +536,74 @@ static SizeT MC_(bytes_heuristically_reachable)[N_LEAK_CHECK_HEURISTICS]
 static SizeT MC_(blocks_heuristically_reachable)[N_LEAK_CHECK_HEURISTICS]
                                                 = {0,0,0,0};
 
+// Smallest granule size of lc_chunk_index, and the number of granules
+// per block above which we make the granules bigger.
+#define LC_CHUNK_INDEX_MIN_SHIFT 12
+#define LC_CHUNK_INDEX_DENSITY   4
+
+static Addr lc_chunk_end(const MC_Chunk* ch)
+{
+   // Zero-sized blocks are considered to cover one byte; see
+   // find_chunk_for.
+   return ch->data + ch->szB + (ch->szB == 0 ? 1 : 0);
+}
+
+// (Re)build lc_chunk_index for the current, sorted, lc_chunks.
+static void build_lc_chunk_index(void)
+{
+   SizeT n_granules, g;
+   Int   i;
+
+   if (lc_chunk_index) {
+      VG_(free)(lc_chunk_index);
+      lc_chunk_index = NULL;
+   }
+   if (lc_n_chunks == 0)
+      return;
+
+   // Bound the size of the index by the number of blocks, so that a
+   // sparse heap spread over a large address range doesn't need a huge
+   // index.
+   lc_chunk_index_shift = LC_CHUNK_INDEX_MIN_SHIFT;
+   while (((lc_chunks_max_addr - lc_chunks_min_addr - 1)
+           >> lc_chunk_index_shift) + 1
+          > LC_CHUNK_INDEX_DENSITY * (SizeT)lc_n_chunks)
+      lc_chunk_index_shift++;
+   n_granules = ((lc_chunks_max_addr - lc_chunks_min_addr - 1)
+                 >> lc_chunk_index_shift) + 1;
+
+   // One more entry than there are granules, so that
+   // lc_chunk_index[g+1] is always valid.
+   lc_chunk_index = VG_(malloc)("mc.blci.1", (n_granules + 1) * sizeof(Int));
+   i = 0;
+   for (g = 0; g <= n_granules; g++) {
+      Addr granule_start = lc_chunks_min_addr + (g << lc_chunk_index_shift);
+      while (i < lc_n_chunks && lc_chunk_end(lc_chunks[i]) <= granule_start)
+         i++;
+      lc_chunk_index[g] = i;
+   }
+   tl_assert(lc_chunk_index[n_granules] == lc_n_chunks);
+}
+
+// Like find_chunk_for(ptr, lc_chunks, lc_n_chunks), using lc_chunk_index.
+// ptr must be in [lc_chunks_min_addr, lc_chunks_max_addr).
+static Int lc_find_chunk_for(Addr ptr)
+{
+   SizeT g  = (ptr - lc_chunks_min_addr) >> lc_chunk_index_shift;
+   Int   lo = lc_chunk_index[g];
+   Int   hi = lc_chunk_index[g+1];
+   Int   ch_no;
+
+   if (hi == lc_n_chunks)
+      hi = lc_n_chunks - 1;
+   // Most non-pointers that get this far land before the first
+   // candidate block, in the gap between two blocks.
+   if (lo > hi || ptr < lc_chunks[lo]->data)
+      return -1;
+   ch_no = find_chunk_for(ptr, &lc_chunks[lo], hi - lo + 1);
+   return ch_no == -1 ? -1 : lo + ch_no;
+}
+
 // Determines if a pointer is to a chunk.  Returns the chunk number et al
 // via call-by-reference.
 static Bool
@@ -528,37 +613,40 @@ lc_is_a_chunk_ptr(Addr ptr, Int* pch_no, MC_Chunk** pch, LC_Extra** pex)
    MC_Chunk* ch;
    LC_Extra* ex;
 
-   // Quick filter. Note: implemented with am, not with get_vabits2
-   // as ptr might be random data pointing anywhere. On 64 bit
-   // platforms, getting va bits for random data can be quite costly
-   // due to the secondary map.
-   if (!VG_(am_is_valid_for_client)(ptr, 1, VKI_PROT_READ)) {
+   // Quickest filter: anything outside the heap can't be a chunk pointer.
+   if (ptr < lc_chunks_min_addr || ptr >= lc_chunks_max_addr)
       return False;
-   } else {
-      ch_no = find_chunk_for(ptr, lc_chunks, lc_n_chunks);
-      tl_assert(ch_no >= -1 && ch_no < lc_n_chunks);
 
-      if (ch_no == -1) {
-         return False;
-      } else {
-         // Ok, we've found a pointer to a chunk.  Get the MC_Chunk and its
-         // LC_Extra.
-         ch = lc_chunks[ch_no];
-         ex = &(lc_extras[ch_no]);
+   // Find the block, if any; this only looks at lc_chunks and
+   // lc_chunk_index, so it is cheap even for random data.
+   ch_no = lc_find_chunk_for(ptr);
+   tl_assert(ch_no >= -1 && ch_no < lc_n_chunks);
+   if (ch_no == -1)
+      return False;
 
-         tl_assert(ptr >= ch->data);
-         tl_assert(ptr < ch->data + ch->szB + (ch->szB==0  ? 1  : 0));
+   // The block might be in memory that is no longer readable, eg. a
+   // MALLOCLIKE block in memory that was unmapped.  Note: implemented
+   // with am, not with get_vabits2.  On 64 bit platforms, getting va
+   // bits can be quite costly due to the secondary map.
+   if (!VG_(am_is_valid_for_client)(ptr, 1, VKI_PROT_READ))
+      return False;
 
-         if (VG_DEBUG_LEAKCHECK)
-            VG_(printf)("ptr=%#lx -> block %d\n", ptr, ch_no);
+   // Ok, we've found a pointer to a chunk.  Get the MC_Chunk and its
+   // LC_Extra.
+   ch = lc_chunks[ch_no];
+   ex = &(lc_extras[ch_no]);
 
-         *pch_no = ch_no;
-         *pch    = ch;
-         *pex    = ex;
+   tl_assert(ptr >= ch->data);
+   tl_assert(ptr < ch->data + ch->szB + (ch->szB==0  ? 1  : 0));
 
-         return True;
-      }
-   }
+   if (VG_DEBUG_LEAKCHECK)
+      VG_(printf)("ptr=%#lx -> block %d\n", ptr, ch_no);
+
+   *pch_no = ch_no;
+   *pch    = ch;
+   *pex    = ex;
+
+   return True;
 }
 
 // Push a chunk (well, just its index) onto the mark stack.
@@ -1305,6 +1393,7 @@ static void print_results(ThreadId tid, LeakCheckParams* lcp)
 {
    Int          i, n_lossrecords, start_lr_output_scan;
    LossRecord*  lr;
+   LossRecord*  prev_lr;
    Bool         is_suppressed;
    /* old_* variables are used to report delta in summary.  */
    SizeT        old_bytes_leaked      = MC_(bytes_leaked);
@@ -1367,6 +1456,9 @@ static void print_results(ThreadId tid, LeakCheckParams* lcp)
    lr_array = NULL;
 
    // Convert the chunks into loss records, merging them where appropriate.
+   // Blocks adjacent in memory were often allocated by the same code, so
+   // try the loss record of the previous block before searching lr_table.
+   prev_lr = NULL;
    for (i = 0; i < lc_n_chunks; i++) {
       MC_Chunk*     ch = lc_chunks[i];
       LC_Extra*     ex = &(lc_extras)[i];
@@ -1384,7 +1476,12 @@ static void print_results(ThreadId tid, LeakCheckParams* lcp)
                        ch->data, (SizeT)ch->szB);
      }
 
-      old_lr = VG_(OSetGen_Lookup)(lr_table, &lrkey);
+      if (prev_lr != NULL
+          && prev_lr->key.state == lrkey.state
+          && prev_lr->key.allocated_at == lrkey.allocated_at)
+         old_lr = prev_lr;
+      else
+         old_lr = VG_(OSetGen_Lookup)(lr_table, &lrkey);
       if (old_lr) {
          // We found an existing loss record matching this chunk.  Update the
          // loss record's details in-situ.  This is safe because we don't
@@ -1393,6 +1490,7 @@ static void print_results(ThreadId tid, LeakCheckParams* lcp)
          if (ex->state == Unreached)
             old_lr->indirect_szB += ex->IorC.indirect_szB;
          old_lr->num_blocks++;
+         prev_lr = old_lr;
       } else {
          // No existing loss record matches this chunk.  Create a new loss
          // record, initialise it from the chunk, and insert it into lr_table.
@@ -1408,6 +1506,7 @@ static void print_results(ThreadId tid, LeakCheckParams* lcp)
          lr->old_indirect_szB = 0;
          lr->old_num_blocks   = 0;
          VG_(OSetGen_Insert)(lr_table, lr);
+         prev_lr = lr;
       }
    }
 
@@ -1790,6 +1889,7 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    }
    lc_chunks = find_active_chunks(&lc_n_chunks);
    lc_chunks_n_frees_marker = MC_(get_cmalloc_n_frees)();
+   lc_chunks_min_addr = lc_chunks_max_addr = 0;
    if (lc_n_chunks == 0) {
       tl_assert(lc_chunks == NULL);
       if (lr_table != NULL) {
@@ -1809,7 +1909,17 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
    }
 
    // Sort the array so blocks are in ascending order in memory.
-   VG_(ssort)(lc_chunks, lc_n_chunks, sizeof(VgHashNode*), compare_MC_Chunks);
+   // find_active_chunks has already sorted the malloc'd blocks, so unless
+   // there are mempool blocks the array is in order already.  Don't pay
+   // for a second sort of a possibly huge array in that case: this
+   // matters for programs doing frequent (delta) leak searches.
+   for (i = 0; i < lc_n_chunks-1; i++) {
+      if (lc_chunks[i]->data > lc_chunks[i+1]->data)
+         break;
+   }
+   if (i < lc_n_chunks-1)
+      VG_(ssort)(lc_chunks, lc_n_chunks, sizeof(VgHashNode*),
+                 compare_MC_Chunks);
 
    // Sanity check -- make sure they're in order.
    for (i = 0; i < lc_n_chunks-1; i++) {
@@ -1879,6 +1989,11 @@ void MC_(detect_memory_leaks) ( ThreadId tid, LeakCheckParams* lcp)
       }
    }
 
+   // The blocks are now sorted and disjoint, so the last one ends highest.
+   lc_chunks_min_addr = lc_chunks[0]->data;
+   lc_chunks_max_addr = lc_chunk_end(lc_chunks[lc_n_chunks-1]);
+   build_lc_chunk_index();
+
    // Initialise lc_extras.
    if (lc_extras) {
       VG_(free)(lc_extras);
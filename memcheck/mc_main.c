@@ -145,9 +145,11 @@ static void ocache_sarp_Clear_Origins ( Addr, UWord ); /* fwds */
    scheme we'd have a four-level table which would require too many memory
    accesses.  So instead the top-level map table has 2^20 entries (indexed
    using bits 16..35 of the address);  this covers the bottom 64GB.  Any
-   accesses above 64GB are handled with a slow, sparse auxiliary table.
-   Valgrind's address space manager tries very hard to keep things below
-   this 64GB barrier so that performance doesn't suffer too much.
+   accesses above 64GB are handled with a sparse three-level auxiliary
+   table, which is not used by the fastest paths of the load and store
+   helpers.  Valgrind's address space manager tries very hard to keep
+   things below this 64GB barrier so that performance doesn't suffer too
+   much.
 
    Note that this file has a lot of different functions for reading and
    writing shadow memory.  Only a couple are strictly necessary (eg.
@@ -286,25 +288,48 @@ typedef
 #define SM_DIST_NOACCESS   0
 #define SM_DIST_UNDEFINED  1
 #define SM_DIST_DEFINED    2
+#define N_SM_DIST          3
+
+// With --dedup-secmaps=yes, identical non-distinguished secondaries
+// are merged into shared, reference counted copies.  These are kept
+// in the same array as the distinguished secondaries, just after
+// them, so that is_distinguished_sm is true for them as well: hence
+// they are never modified either, and every path writing to a
+// secondary gives the writer a private copy first.  That array is
+// only allocated by init_dedup_secmaps; by default the distinguished
+// secondaries stay in sm_distinguished_static.
+#if VG_WORDSIZE == 4
+#  define N_SM_SHARED      256
+#else
+#  define N_SM_SHARED      4096
+#endif
 
-static SecMap sm_distinguished[3];
+static SecMap  sm_distinguished_static[N_SM_DIST];
+static SecMap* sm_distinguished = sm_distinguished_static;
 
 static INLINE Bool is_distinguished_sm ( SecMap* sm ) {
-   return sm >= &sm_distinguished[0] && sm <= &sm_distinguished[2];
+   if (LIKELY(!MC_(clo_dedup_secmaps)))
+      return sm >= &sm_distinguished_static[0]
+             && sm <= &sm_distinguished_static[N_SM_DIST-1];
+   return (UWord)((Addr)sm - (Addr)sm_distinguished)
+          < (N_SM_DIST + N_SM_SHARED) * sizeof(SecMap);
 }
 
-// Forward declaration
+static INLINE Bool is_shared_sm ( SecMap* sm ) {
+   return is_distinguished_sm(sm) && sm >= &sm_distinguished[N_SM_DIST];
+}
+
+// Forward declarations
 static void update_SM_counts(SecMap* oldSM, SecMap* newSM);
+static void unref_shared_sm ( SecMap* sm );
 
-/* dist_sm points to one of our three distinguished secondaries.  Make
-   a copy of it so that we can write to it.
+/* dist_sm points to one of our three distinguished secondaries, or to
+   a shared secondary.  Make a copy of it so that we can write to it.
 */
 static SecMap* copy_for_writing ( SecMap* dist_sm )
 {
    SecMap* new_sm;
-   tl_assert(dist_sm == &sm_distinguished[0]
-          || dist_sm == &sm_distinguished[1]
-          || dist_sm == &sm_distinguished[2]);
+   tl_assert(is_distinguished_sm(dist_sm));
 
    new_sm = VG_(am_shadow_alloc)(sizeof(SecMap));
    if (new_sm == NULL)
@@ -312,6 +337,8 @@ static SecMap* copy_for_writing ( SecMap* dist_sm )
                                    sizeof(SecMap) );
    VG_(memcpy)(new_sm, dist_sm, sizeof(SecMap));
    update_SM_counts(dist_sm, new_sm);
+   if (is_shared_sm(dist_sm))
+      unref_shared_sm(dist_sm);
    return new_sm;
 }
 
@@ -323,18 +350,24 @@ static Int   n_noaccess_SMs    = N_PRIMARY_MAP; // start with many noaccess DSMs
 static Int   n_undefined_SMs   = 0;
 static Int   n_defined_SMs     = 0;
 static Int   n_non_DSM_SMs     = 0;
+static Int   n_shared_SM_refs  = 0; // # of references to shared SMs
+static Int   n_shared_SMs      = 0; // # of shared SMs in use
 static Int   max_noaccess_SMs  = 0;
 static Int   max_undefined_SMs = 0;
 static Int   max_defined_SMs   = 0;
 static Int   max_non_DSM_SMs   = 0;
+static Int   max_shared_SMs    = 0;
+
+/* # of secondaries found by the dedup pass to be equal to a
+   distinguished one, resp. to another secondary. */
+static ULong n_dedup_to_DSM    = 0;
+static ULong n_dedup_to_shared = 0;
 
-/* # searches initiated in auxmap_L1, and # base cmps required */
-static ULong n_auxmap_L1_searches  = 0;
-static ULong n_auxmap_L1_cmps      = 0;
-/* # of searches that missed in auxmap_L1 and therefore had to
-   be handed to auxmap_L2. And the number of nodes inserted. */
-static ULong n_auxmap_L2_searches  = 0;
-static ULong n_auxmap_L2_nodes     = 0;
+/* # searches in the auxiliary primary map, and # of second and
+   third level tables allocated for it. */
+static ULong n_auxmap_searches     = 0;
+static ULong n_auxmap_L2_tables    = 0;
+static ULong n_auxmap_L3_tables    = 0;
 
 static Int   n_sanity_cheap     = 0;
 static Int   n_sanity_expensive = 0;
@@ -347,12 +380,14 @@ static void update_SM_counts(SecMap* oldSM, SecMap* newSM)
    if      (oldSM == &sm_distinguished[SM_DIST_NOACCESS ]) n_noaccess_SMs --;
    else if (oldSM == &sm_distinguished[SM_DIST_UNDEFINED]) n_undefined_SMs--;
    else if (oldSM == &sm_distinguished[SM_DIST_DEFINED  ]) n_defined_SMs  --;
+   else if (is_shared_sm(oldSM))                           n_shared_SM_refs--;
    else                                                  { n_non_DSM_SMs  --;
                                                            n_deissued_SMs ++; }
 
    if      (newSM == &sm_distinguished[SM_DIST_NOACCESS ]) n_noaccess_SMs ++;
    else if (newSM == &sm_distinguished[SM_DIST_UNDEFINED]) n_undefined_SMs++;
    else if (newSM == &sm_distinguished[SM_DIST_DEFINED  ]) n_defined_SMs  ++;
+   else if (is_shared_sm(newSM))                           n_shared_SM_refs++;
    else                                                  { n_non_DSM_SMs  ++;
                                                            n_issued_SMs   ++; }
 
@@ -360,6 +395,7 @@ static void update_SM_counts(SecMap* oldSM, SecMap* newSM)
    if (n_undefined_SMs > max_undefined_SMs) max_undefined_SMs = n_undefined_SMs;
    if (n_defined_SMs   > max_defined_SMs  ) max_defined_SMs   = n_defined_SMs;
    if (n_non_DSM_SMs   > max_non_DSM_SMs  ) max_non_DSM_SMs   = n_non_DSM_SMs;   
+   if (n_shared_SMs    > max_shared_SMs   ) max_shared_SMs    = n_shared_SMs;
 }
 
 /* --------------- Primary maps --------------- */
@@ -371,47 +407,76 @@ static void update_SM_counts(SecMap* oldSM, SecMap* newSM)
 static SecMap* primary_map[N_PRIMARY_MAP];
 
 
-/* An entry in the auxiliary primary map.  base must be a 64k-aligned
-   value, and sm points at the relevant secondary map.  As with the
-   main primary map, the secondary may be either a real secondary, or
-   one of the three distinguished secondaries.  DO NOT CHANGE THIS
-   LAYOUT: the first word has to be the key for OSet fast lookups.
+/* The auxiliary primary map.  On 64-bit platforms, this covers the
+   address space above MAX_PRIMARY_ADDRESS.  It is a three level radix
+   tree indexed by a >> 16, so that finding the secondary map for an
+   address takes three loads no matter where the address is:
+
+      bits 63 .. 48 of a  index  auxmap_L1, pointing at an AuxMapL2
+      bits 47 .. 28       index  the AuxMapL2, pointing at an AuxMapL3
+      bits 27 .. 16       index  the AuxMapL3, pointing at a SecMap
+
+   An AuxMapL3 covers 256MB and is allocated, with all entries set to
+   the noaccess distinguished secondary, the first time a secondary
+   map in that range is needed.  An AuxMapL2 covers 256TB, so a 48 bit
+   address space needs only one and a 57 bit one at most 512.  AuxMapL2
+   tables are big but sparse; since they are mmap-ed anonymously only
+   the pages actually referring to an AuxMapL3 take up memory.  As with
+   the main primary map, the secondaries may be either real
+   secondaries, or one of the three distinguished secondaries.
+
+   On 32-bit platforms, the main primary map covers everything and the
+   auxiliary map stays empty.
 */
-typedef
-   struct { 
-      Addr    base;
-      SecMap* sm;
-   }
-   AuxMapEnt;
+#define AUXMAP_L3_BITS 12
+#define AUXMAP_L2_BITS 20
+#if VG_WORDSIZE == 4
+#  define AUXMAP_L1_BITS 0
+#else
+#  define AUXMAP_L1_BITS (64 - 16 - AUXMAP_L2_BITS - AUXMAP_L3_BITS)
+#endif
 
-/* Tunable parameter: How big is the L1 queue? */
-#define N_AUXMAP_L1 24
+#define N_AUXMAP_L1 (((UWord)1) << AUXMAP_L1_BITS)
+#define N_AUXMAP_L2 (((UWord)1) << AUXMAP_L2_BITS)
+#define N_AUXMAP_L3 (((UWord)1) << AUXMAP_L3_BITS)
 
-/* Tunable parameter: How far along the L1 queue to insert
-   entries resulting from L2 lookups? */
-#define AUXMAP_L1_INSERT_IX 12
+typedef
+   struct {
+      SecMap* sm[N_AUXMAP_L3];
+   }
+   AuxMapL3;
 
-static struct {
-          Addr       base;
-          AuxMapEnt* ent; // pointer to the matching auxmap_L2 node
-       } 
-       auxmap_L1[N_AUXMAP_L1];
+typedef
+   struct {
+      AuxMapL3* l3[N_AUXMAP_L2];
+   }
+   AuxMapL2;
 
-static OSet* auxmap_L2 = NULL;
+static AuxMapL2* auxmap_L1[N_AUXMAP_L1];
 
-static void init_auxmap_L1_L2 ( void )
+/* Split the 64k chunk number of 'a' into the indices of the three
+   levels. */
+static INLINE UWord auxmap_L1_index ( Addr a )
 {
-   Int i;
-   for (i = 0; i < N_AUXMAP_L1; i++) {
-      auxmap_L1[i].base = 0;
-      auxmap_L1[i].ent  = NULL;
-   }
+   return (UWord)((((ULong)a) >> 16) >> (AUXMAP_L2_BITS + AUXMAP_L3_BITS));
+}
+static INLINE UWord auxmap_L2_index ( Addr a )
+{
+   return (UWord)((((ULong)a) >> (16 + AUXMAP_L3_BITS)) & (N_AUXMAP_L2 - 1));
+}
+static INLINE UWord auxmap_L3_index ( Addr a )
+{
+   return (UWord)((((ULong)a) >> 16) & (N_AUXMAP_L3 - 1));
+}
 
-   tl_assert(0 == offsetof(AuxMapEnt,base));
-   tl_assert(sizeof(Addr) == sizeof(void*));
-   auxmap_L2 = VG_(OSetGen_Create)( /*keyOff*/  offsetof(AuxMapEnt,base),
-                                    /*fastCmp*/ NULL,
-                                    VG_(malloc), "mc.iaLL.1", VG_(free) );
+static void init_auxmap ( void )
+{
+   UWord i;
+   for (i = 0; i < N_AUXMAP_L1; i++)
+      auxmap_L1[i] = NULL;
+   /* The AuxMapL3s must not straddle MAX_PRIMARY_ADDRESS, else the
+      sanity check cannot tell which entries should be unused. */
+   tl_assert(0 == (N_PRIMARY_MAP & (N_AUXMAP_L3 - 1)));
 }
 
 /* Check representation invariants; if OK return NULL; else a
@@ -419,179 +484,112 @@ static void init_auxmap_L1_L2 ( void )
    non-distinguished secondary maps referred to from the auxiliary
    primary maps. */
 
-static const HChar* check_auxmap_L1_L2_sanity ( Word* n_secmaps_found )
+static const HChar* check_auxmap_sanity ( Word* n_secmaps_found )
 {
-   Word i, j;
-   /* On a 32-bit platform, the L2 and L1 tables should
-      both remain empty forever.
+   UWord i, j, k;
+   ULong l2_seen = 0, l3_seen = 0;
+   /* On a 32-bit platform, the auxiliary map should remain empty
+      forever.
 
       On a 64-bit platform:
-      In the L2 table:
-       all .base & 0xFFFF == 0
-       all .base > MAX_PRIMARY_ADDRESS
-      In the L1 table:
-       all .base & 0xFFFF == 0
-       all (.base > MAX_PRIMARY_ADDRESS
-            .base & 0xFFFF == 0
-            and .ent points to an AuxMapEnt with the same .base)
-           or
-           (.base == 0 and .ent == NULL)
+       the number of AuxMapL2s and AuxMapL3s is as counted
+       no AuxMapL3 covers addresses <= MAX_PRIMARY_ADDRESS
+       all entries of an AuxMapL3 are non-NULL
    */
    *n_secmaps_found = 0;
    if (sizeof(void*) == 4) {
       /* 32-bit platform */
-      if (VG_(OSetGen_Size)(auxmap_L2) != 0)
-         return "32-bit: auxmap_L2 is non-empty";
-      for (i = 0; i < N_AUXMAP_L1; i++) 
-        if (auxmap_L1[i].base != 0 || auxmap_L1[i].ent != NULL)
-      return "32-bit: auxmap_L1 is non-empty";
-   } else {
-      /* 64-bit platform */
-      UWord elems_seen = 0;
-      AuxMapEnt *elem, *res;
-      AuxMapEnt key;
-      /* L2 table */
-      VG_(OSetGen_ResetIter)(auxmap_L2);
-      while ( (elem = VG_(OSetGen_Next)(auxmap_L2)) ) {
-         elems_seen++;
-         if (0 != (elem->base & (Addr)0xFFFF))
-            return "64-bit: nonzero .base & 0xFFFF in auxmap_L2";
-         if (elem->base <= MAX_PRIMARY_ADDRESS)
-            return "64-bit: .base <= MAX_PRIMARY_ADDRESS in auxmap_L2";
-         if (elem->sm == NULL)
-            return "64-bit: .sm in _L2 is NULL";
-         if (!is_distinguished_sm(elem->sm))
-            (*n_secmaps_found)++;
-      }
-      if (elems_seen != n_auxmap_L2_nodes)
-         return "64-bit: disagreement on number of elems in _L2";
-      /* Check L1-L2 correspondence */
-      for (i = 0; i < N_AUXMAP_L1; i++) {
-         if (auxmap_L1[i].base == 0 && auxmap_L1[i].ent == NULL)
-            continue;
-         if (0 != (auxmap_L1[i].base & (Addr)0xFFFF))
-            return "64-bit: nonzero .base & 0xFFFF in auxmap_L1";
-         if (auxmap_L1[i].base <= MAX_PRIMARY_ADDRESS)
-            return "64-bit: .base <= MAX_PRIMARY_ADDRESS in auxmap_L1";
-         if (auxmap_L1[i].ent == NULL)
-            return "64-bit: .ent is NULL in auxmap_L1";
-         if (auxmap_L1[i].ent->base != auxmap_L1[i].base)
-            return "64-bit: _L1 and _L2 bases are inconsistent";
-         /* Look it up in auxmap_L2. */
-         key.base = auxmap_L1[i].base;
-         key.sm   = 0;
-         res = VG_(OSetGen_Lookup)(auxmap_L2, &key);
-         if (res == NULL)
-            return "64-bit: _L1 .base not found in _L2";
-         if (res != auxmap_L1[i].ent)
-            return "64-bit: _L1 .ent disagrees with _L2 entry";
-      }
-      /* Check L1 contains no duplicates */
-      for (i = 0; i < N_AUXMAP_L1; i++) {
-         if (auxmap_L1[i].base == 0)
+      for (i = 0; i < N_AUXMAP_L1; i++)
+         if (auxmap_L1[i] != NULL)
+            return "32-bit: auxmap is non-empty";
+      return NULL;
+   }
+
+   /* 64-bit platform */
+   for (i = 0; i < N_AUXMAP_L1; i++) {
+      AuxMapL2* l2 = auxmap_L1[i];
+      if (l2 == NULL)
+         continue;
+      l2_seen++;
+      for (j = 0; j < N_AUXMAP_L2; j++) {
+         AuxMapL3* l3 = l2->l3[j];
+         if (l3 == NULL)
             continue;
-	 for (j = i+1; j < N_AUXMAP_L1; j++) {
-            if (auxmap_L1[j].base == 0)
-               continue;
-            if (auxmap_L1[j].base == auxmap_L1[i].base)
-               return "64-bit: duplicate _L1 .base entries";
+         l3_seen++;
+         if (i == 0 && (j << AUXMAP_L3_BITS) < N_PRIMARY_MAP)
+            return "64-bit: AuxMapL3 for addresses <= MAX_PRIMARY_ADDRESS";
+         for (k = 0; k < N_AUXMAP_L3; k++) {
+            if (l3->sm[k] == NULL)
+               return "64-bit: .sm in AuxMapL3 is NULL";
+            if (!is_distinguished_sm(l3->sm[k]))
+               (*n_secmaps_found)++;
          }
       }
    }
+   if (l2_seen != n_auxmap_L2_tables)
+      return "64-bit: disagreement on number of AuxMapL2s";
+   if (l3_seen != n_auxmap_L3_tables)
+      return "64-bit: disagreement on number of AuxMapL3s";
    return NULL; /* ok */
 }
 
-static void insert_into_auxmap_L1_at ( Word rank, AuxMapEnt* ent )
+/* Return a pointer to the auxiliary map entry for 'a', or NULL if the
+   AuxMapL3 covering 'a' has not been allocated yet. */
+static INLINE SecMap** maybe_find_in_auxmap ( Addr a )
 {
-   Word i;
-   tl_assert(ent);
-   tl_assert(rank >= 0 && rank < N_AUXMAP_L1);
-   for (i = N_AUXMAP_L1-1; i > rank; i--)
-      auxmap_L1[i] = auxmap_L1[i-1];
-   auxmap_L1[rank].base = ent->base;
-   auxmap_L1[rank].ent  = ent;
+   AuxMapL2* l2;
+   AuxMapL3* l3;
+
+#  if VG_DEBUG_MEMORY >= 1
+   tl_assert(a > MAX_PRIMARY_ADDRESS);
+#  endif
+   n_auxmap_searches++;
+
+   l2 = auxmap_L1[auxmap_L1_index(a)];
+   if (UNLIKELY(l2 == NULL))
+      return NULL;
+   l3 = l2->l3[auxmap_L2_index(a)];
+   if (UNLIKELY(l3 == NULL))
+      return NULL;
+   return &l3->sm[auxmap_L3_index(a)];
 }
 
-static INLINE AuxMapEnt* maybe_find_in_auxmap ( Addr a )
+static SecMap** find_or_alloc_in_auxmap ( Addr a )
 {
-   AuxMapEnt  key;
-   AuxMapEnt* res;
-   Word       i;
+   AuxMapL2** l2p;
+   AuxMapL3** l3p;
+   UWord      i;
 
    tl_assert(a > MAX_PRIMARY_ADDRESS);
-   a &= ~(Addr)0xFFFF;
-
-   /* First search the front-cache, which is a self-organising
-      list containing the most popular entries. */
 
-   if (LIKELY(auxmap_L1[0].base == a))
-      return auxmap_L1[0].ent;
-   if (LIKELY(auxmap_L1[1].base == a)) {
-      Addr       t_base = auxmap_L1[0].base;
-      AuxMapEnt* t_ent  = auxmap_L1[0].ent;
-      auxmap_L1[0].base = auxmap_L1[1].base;
-      auxmap_L1[0].ent  = auxmap_L1[1].ent;
-      auxmap_L1[1].base = t_base;
-      auxmap_L1[1].ent  = t_ent;
-      return auxmap_L1[0].ent;
+   l2p = &auxmap_L1[auxmap_L1_index(a)];
+   if (LIKELY(*l2p != NULL)) {
+      l3p = &(*l2p)->l3[auxmap_L2_index(a)];
+      if (LIKELY(*l3p != NULL))
+         return &(*l3p)->sm[auxmap_L3_index(a)];
    }
 
-   n_auxmap_L1_searches++;
-
-   for (i = 0; i < N_AUXMAP_L1; i++) {
-      if (auxmap_L1[i].base == a) {
-         break;
-      }
+   /* Ok, part of the path to the entry is missing, so we'll have to
+      allocate it.  Fresh mmap-ed memory is zeroed, so a new AuxMapL2
+      has all its entries NULL already. */
+   if (*l2p == NULL) {
+      *l2p = VG_(am_shadow_alloc)(sizeof(AuxMapL2));
+      if (*l2p == NULL)
+         VG_(out_of_memory_NORETURN)( "memcheck:allocate AuxMapL2",
+                                      sizeof(AuxMapL2) );
+      n_auxmap_L2_tables++;
    }
-   tl_assert(i >= 0 && i <= N_AUXMAP_L1);
-
-   n_auxmap_L1_cmps += (ULong)(i+1);
-
-   if (i < N_AUXMAP_L1) {
-      if (i > 0) {
-         Addr       t_base = auxmap_L1[i-1].base;
-         AuxMapEnt* t_ent  = auxmap_L1[i-1].ent;
-         auxmap_L1[i-1].base = auxmap_L1[i-0].base;
-         auxmap_L1[i-1].ent  = auxmap_L1[i-0].ent;
-         auxmap_L1[i-0].base = t_base;
-         auxmap_L1[i-0].ent  = t_ent;
-         i--;
-      }
-      return auxmap_L1[i].ent;
+   l3p = &(*l2p)->l3[auxmap_L2_index(a)];
+   if (*l3p == NULL) {
+      *l3p = VG_(am_shadow_alloc)(sizeof(AuxMapL3));
+      if (*l3p == NULL)
+         VG_(out_of_memory_NORETURN)( "memcheck:allocate AuxMapL3",
+                                      sizeof(AuxMapL3) );
+      for (i = 0; i < N_AUXMAP_L3; i++)
+         (*l3p)->sm[i] = &sm_distinguished[SM_DIST_NOACCESS];
+      n_auxmap_L3_tables++;
    }
-
-   n_auxmap_L2_searches++;
-
-   /* First see if we already have it. */
-   key.base = a;
-   key.sm   = 0;
-
-   res = VG_(OSetGen_Lookup)(auxmap_L2, &key);
-   if (res)
-      insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, res );
-   return res;
-}
-
-static AuxMapEnt* find_or_alloc_in_auxmap ( Addr a )
-{
-   AuxMapEnt *nyu, *res;
-
-   /* First see if we already have it. */
-   res = maybe_find_in_auxmap( a );
-   if (LIKELY(res))
-      return res;
-
-   /* Ok, there's no entry in the secondary map, so we'll have
-      to allocate one. */
-   a &= ~(Addr)0xFFFF;
-
-   nyu = (AuxMapEnt*) VG_(OSetGen_AllocNode)( auxmap_L2, sizeof(AuxMapEnt) );
-   nyu->base = a;
-   nyu->sm   = &sm_distinguished[SM_DIST_NOACCESS];
-   VG_(OSetGen_Insert)( auxmap_L2, nyu );
-   insert_into_auxmap_L1_at( AUXMAP_L1_INSERT_IX, nyu );
-   n_auxmap_L2_nodes++;
-   return nyu;
+   return &(*l3p)->sm[auxmap_L3_index(a)];
 }
 
 /* --------------- SecMap fundamentals --------------- */
@@ -616,8 +614,7 @@ static INLINE SecMap** get_secmap_low_ptr ( Addr a )
 
 static INLINE SecMap** get_secmap_high_ptr ( Addr a )
 {
-   AuxMapEnt* am = find_or_alloc_in_auxmap(a);
-   return &am->sm;
+   return find_or_alloc_in_auxmap(a);
 }
 
 static INLINE SecMap** get_secmap_ptr ( Addr a )
@@ -688,8 +685,237 @@ static SecMap* maybe_get_secmap_for ( Addr a )
    if (a <= MAX_PRIMARY_ADDRESS) {
       return get_secmap_for_reading_low(a);
    } else {
-      AuxMapEnt* am = maybe_find_in_auxmap(a);
-      return am ? am->sm : NULL;
+      SecMap** smp = maybe_find_in_auxmap(a);
+      return smp ? *smp : NULL;
+   }
+}
+
+/* --------------- Secondary map deduplication --------------- */
+
+/* With --dedup-secmaps=yes, an incremental pass over the primary map
+   looks for non-distinguished secondaries which are equal to a
+   distinguished one, or to another secondary.  The former are just
+   replaced by the distinguished secondary.  The latter are replaced
+   by a shared copy, which is reference counted and freed when the
+   last reference to it is replaced.  The pass only looks at the main
+   primary map: shadow memory above MAX_PRIMARY_ADDRESS is normally
+   a small fraction of the total.
+
+   The pass replaces secondaries which the caller might be holding a
+   pointer to, so it must only be run when no such pointer is live:
+   see MC_(maybe_dedup_secmaps). */
+
+/* Run a pass every this many calls of MC_(maybe_dedup_secmaps). */
+#define DEDUP_INTERVAL      1024
+/* Max # of non-distinguished secondaries hashed per pass. */
+#define DEDUP_STEP_SMS      64
+/* Max # of primary map entries visited per pass. */
+#define DEDUP_STEP_ENTRIES  16384
+/* # of entries in the cache of recently hashed secondaries. */
+#define N_DEDUP_CACHE       4096
+
+/* A recently hashed secondary: either a shared one, or the primary map
+   index of a private one that may find a twin later.  Entries are
+   only hints and are checked before being used. */
+typedef
+   struct {
+      UInt hash;
+      Int  shared;  // index of the shared SM, or -1
+      UInt pm_ix;   // primary map index of a candidate, if shared < 0
+   }
+   DedupCacheEnt;
+
+static DedupCacheEnt* dedup_cache = NULL;
+static UInt*          sm_shared_refcount = NULL; // [N_SM_SHARED]
+static Int            sm_shared_first_free = 0;  // all below are in use
+static UWord          dedup_cursor = 0;
+static UInt           dedup_calls = 0;
+
+/* Move the distinguished secondaries into an array with room for the
+   shared ones after them.  This is done before any client memory is
+   made accessible, so every primary map entry still points to the
+   noaccess secondary, and the auxiliary map is empty. */
+static void init_dedup_secmaps ( void )
+{
+   Int i;
+
+   sm_distinguished
+      = VG_(am_shadow_alloc)((N_SM_DIST + N_SM_SHARED) * sizeof(SecMap));
+   if (sm_distinguished == NULL)
+      VG_(out_of_memory_NORETURN)( "memcheck:allocate shared SecMaps",
+                                   (N_SM_DIST + N_SM_SHARED) * sizeof(SecMap) );
+   for (i = 0; i < N_SM_DIST; i++)
+      sm_distinguished[i] = sm_distinguished_static[i];
+   for (i = 0; i < N_PRIMARY_MAP; i++) {
+      tl_assert(primary_map[i]
+                == &sm_distinguished_static[SM_DIST_NOACCESS]);
+      primary_map[i] = &sm_distinguished[SM_DIST_NOACCESS];
+   }
+   for (i = 0; i < N_AUXMAP_L1; i++)
+      tl_assert(auxmap_L1[i] == NULL);
+
+   dedup_cache = VG_(malloc)("mc.ids.1",
+                             N_DEDUP_CACHE * sizeof(DedupCacheEnt));
+   for (i = 0; i < N_DEDUP_CACHE; i++) {
+      dedup_cache[i].hash   = 0;
+      dedup_cache[i].shared = -1;
+      dedup_cache[i].pm_ix  = 0;
+   }
+   sm_shared_refcount = VG_(calloc)("mc.ids.2",
+                                    N_SM_SHARED, sizeof(UInt));
+}
+
+static void free_private_sm ( SecMap* sm )
+{
+   SysRes sres;
+   tl_assert(!is_distinguished_sm(sm));
+   sres = VG_(am_munmap_valgrind)((Addr)sm, sizeof(SecMap));
+   tl_assert2(! sr_isError(sres), "SecMap valgrind munmap failure\n");
+}
+
+static void unref_shared_sm ( SecMap* sm )
+{
+   Int ix = sm - &sm_distinguished[N_SM_DIST];
+   tl_assert(ix >= 0 && ix < N_SM_SHARED);
+   tl_assert(sm_shared_refcount[ix] > 0);
+   sm_shared_refcount[ix]--;
+   if (sm_shared_refcount[ix] == 0) {
+      n_shared_SMs--;
+      if (ix < sm_shared_first_free)
+         sm_shared_first_free = ix;
+   }
+}
+
+/* Return the index of a free shared SM, or -1 if none is left. */
+static Int alloc_shared_sm ( void )
+{
+   Int ix;
+   for (ix = sm_shared_first_free; ix < N_SM_SHARED; ix++) {
+      if (sm_shared_refcount[ix] == 0) {
+         sm_shared_first_free = ix + 1;
+         n_shared_SMs++;
+         return ix;
+      }
+   }
+   sm_shared_first_free = N_SM_SHARED;
+   return -1;
+}
+
+/* If all bytes of 'sm' have the same V+A bits, return the matching
+   distinguished secondary, else NULL.  Partially defined bytes are
+   never uniform, as their V bits live in the sec-V-bits table. */
+static SecMap* uniform_dsm_for ( SecMap* sm )
+{
+   const UWord* w = (const UWord*)sm->vabits8;
+   UWord first = w[0];
+   UInt  i;
+   for (i = 1; i < SM_CHUNKS / sizeof(UWord); i++)
+      if (w[i] != first)
+         return NULL;
+   switch (sm->vabits8[0]) {
+      case VA_BITS8_NOACCESS:  return &sm_distinguished[SM_DIST_NOACCESS];
+      case VA_BITS8_UNDEFINED: return &sm_distinguished[SM_DIST_UNDEFINED];
+      case VA_BITS8_DEFINED:   return &sm_distinguished[SM_DIST_DEFINED];
+      default:                 return NULL;
+   }
+}
+
+static UInt hash_sm ( SecMap* sm )
+{
+   const UWord* w = (const UWord*)sm->vabits8;
+   UWord h = 0;
+   UInt  i;
+   for (i = 0; i < SM_CHUNKS / sizeof(UWord); i++)
+      h = (h ^ w[i]) * 0x9E3779B1UL + (h >> 13);
+   return (UInt)(h ^ (h >> 16));
+}
+
+/* Replace the private secondary in primary_map[pm_ix] by 'new_sm', a
+   distinguished or shared one with the same contents. */
+static void replace_private_sm ( UWord pm_ix, SecMap* new_sm )
+{
+   SecMap* old_sm = primary_map[pm_ix];
+   tl_assert(!is_distinguished_sm(old_sm));
+   primary_map[pm_ix] = new_sm;
+   update_SM_counts(old_sm, new_sm);
+   free_private_sm(old_sm);
+}
+
+static void dedup_one_secmap ( UWord pm_ix )
+{
+   SecMap*        sm = primary_map[pm_ix];
+   SecMap*        twin;
+   DedupCacheEnt* ent;
+   UInt           h;
+   Int            ix;
+
+   twin = uniform_dsm_for(sm);
+   if (twin) {
+      replace_private_sm(pm_ix, twin);
+      n_dedup_to_DSM++;
+      return;
+   }
+
+   h = hash_sm(sm);
+   ent = &dedup_cache[h % N_DEDUP_CACHE];
+   if (ent->hash != h) {
+      ent->hash   = h;
+      ent->shared = -1;
+      ent->pm_ix  = pm_ix;
+      return;
+   }
+
+   /* A secondary with the same hash has been seen before: either
+      share an existing shared copy, or make one. */
+   if (ent->shared >= 0 && sm_shared_refcount[ent->shared] > 0) {
+      twin = &sm_distinguished[N_SM_DIST + ent->shared];
+      if (VG_(memcmp)(twin, sm, sizeof(SecMap)) == 0) {
+         sm_shared_refcount[ent->shared]++;
+         replace_private_sm(pm_ix, twin);
+         n_dedup_to_shared++;
+         return;
+      }
+   } else if (ent->shared < 0 && ent->pm_ix != pm_ix
+              && !is_distinguished_sm(primary_map[ent->pm_ix])
+              && VG_(memcmp)(primary_map[ent->pm_ix], sm,
+                             sizeof(SecMap)) == 0) {
+      ix = alloc_shared_sm();
+      if (ix >= 0) {
+         twin = &sm_distinguished[N_SM_DIST + ix];
+         VG_(memcpy)(twin, sm, sizeof(SecMap));
+         sm_shared_refcount[ix] = 2;
+         replace_private_sm(ent->pm_ix, twin);
+         replace_private_sm(pm_ix, twin);
+         n_dedup_to_shared += 2;
+         ent->shared = ix;
+         return;
+      }
+   }
+
+   /* No luck.  Remember this one as a candidate instead. */
+   ent->shared = -1;
+   ent->pm_ix  = pm_ix;
+}
+
+void MC_(maybe_dedup_secmaps) ( void )
+{
+   UInt n_hashed, n_visited;
+
+   if (LIKELY(!MC_(clo_dedup_secmaps)))
+      return;
+   if (++dedup_calls < DEDUP_INTERVAL)
+      return;
+   dedup_calls = 0;
+
+   n_hashed = 0;
+   for (n_visited = 0; n_visited < DEDUP_STEP_ENTRIES; n_visited++) {
+      UWord pm_ix = dedup_cursor;
+      dedup_cursor = (dedup_cursor + 1) & (N_PRIMARY_MAP - 1);
+      if (is_distinguished_sm(primary_map[pm_ix]))
+         continue;
+      dedup_one_secmap(pm_ix);
+      if (++n_hashed == DEDUP_STEP_SMS)
+         break;
    }
 }
 
@@ -1561,7 +1787,7 @@ void mc_STOREVn_slow ( Addr a, SizeT nBits, ULong vbytes, Bool bigendian )
 static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
                                       UWord dsm_num )
 {
-   UWord    sm_off, sm_off16;
+   UWord    sm_off;
    UWord    vabits2 = vabits16 & 0x3;
    SizeT    lenA, lenB, len_to_next_secmap;
    Addr     aNext;
@@ -1696,14 +1922,14 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       a    += 1;
       lenA -= 1;
    }
-   // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenA < 8) break;
+   // 8-aligned, 8 byte steps.  All the vabits8 entries get the same
+   // value, so fill them in one go rather than a UShort at a time.
+   if (lenA >= 8) {
+      SizeT len8 = VG_ROUNDDN(lenA, 8);
       PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_LOOP8A);
-      sm_off16 = SM_OFF_16(a);
-      ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
-      a    += 8;
-      lenA -= 8;
+      VG_(memset)( &(sm->vabits8[SM_OFF(a)]), vabits16 & 0xff, len8 >> 2 );
+      a    += len8;
+      lenA -= len8;
    }
    // 1 byte steps
    while (True) {
@@ -1731,14 +1957,16 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
       tl_assert(is_start_of_sm(a));
       PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_LOOP64K);
       sm_ptr = get_secmap_ptr(a);
+      update_SM_counts(*sm_ptr, example_dsm);
       if (!is_distinguished_sm(*sm_ptr)) {
          PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_LOOP64K_FREE_DIST_SM);
          // Free the non-distinguished sec-map that we're replacing.  This
          // case happens moderately often, enough to be worthwhile.
          SysRes sres = VG_(am_munmap_valgrind)((Addr)*sm_ptr, sizeof(SecMap));
          tl_assert2(! sr_isError(sres), "SecMap valgrind munmap failure\n");
+      } else if (is_shared_sm(*sm_ptr)) {
+         unref_shared_sm(*sm_ptr);
       }
-      update_SM_counts(*sm_ptr, example_dsm);
       // Make the sec-map entry point to the example DSM
       *sm_ptr = example_dsm;
       lenB -= SM_SIZE;
@@ -1769,14 +1997,13 @@ static void set_address_range_perms ( Addr a, SizeT lenT, UWord vabits16,
    }
    sm = *sm_ptr;
 
-   // 8-aligned, 8 byte steps
-   while (True) {
-      if (lenB < 8) break;
+   // 8-aligned, 8 byte steps (see part 1)
+   if (lenB >= 8) {
+      SizeT len8 = VG_ROUNDDN(lenB, 8);
       PROF_EVENT(MCPE_SET_ADDRESS_RANGE_PERMS_LOOP8B);
-      sm_off16 = SM_OFF_16(a);
-      ((UShort*)(sm->vabits8))[sm_off16] = vabits16;
-      a    += 8;
-      lenB -= 8;
+      VG_(memset)( &(sm->vabits8[SM_OFF(a)]), vabits16 & 0xff, len8 >> 2 );
+      a    += len8;
+      lenB -= len8;
    }
    // 1 byte steps
    while (True) {
@@ -1900,10 +2127,72 @@ static void make_mem_defined_if_noaccess ( Addr a, SizeT len )
 /* --- Block-copy permissions (needed for implementing realloc() and
        sys_mremap). --- */
 
+// A word's worth of vabits8 entries.  VA_BITSW_UNDEFINED doubles as the
+// mask of the low bit of every 2-bit field; a field is PARTDEFINED iff
+// both of its bits are set.
+#define VA_BITSW_UNDEFINED    (~(UWord)0 / 3)   // 01_01_01_01b x N
+#define VA_BITSW_DEFINED      (VA_BITSW_UNDEFINED << 1)
+
+/* Copy the V+A bits of [src, src+len) to [dst, dst+len).  src, dst and
+   len must be 4-aligned, the ranges must not overlap and neither may
+   cross a secondary map boundary.  A distinguished source is copied by
+   pointing (or setting) dst at the same DSM; otherwise the vabits8
+   entries are copied in one go, and only then do we look for bytes
+   that need their secondary V bits copied too. */
+static void copy_vabits_within_sm ( Addr src, Addr dst, SizeT len )
+{
+   SecMap* src_sm;
+   SecMap* dst_sm;
+   UChar*  s8;
+   SizeT   n8 = len >> 2;
+   SizeT   k, j;
+
+   src_sm = get_secmap_for_reading(src);
+   if (src_sm == &sm_distinguished[SM_DIST_NOACCESS]) {
+      set_address_range_perms(dst, len, VA_BITS16_NOACCESS, SM_DIST_NOACCESS);
+      return;
+   }
+   if (src_sm == &sm_distinguished[SM_DIST_UNDEFINED]) {
+      set_address_range_perms(dst, len, VA_BITS16_UNDEFINED,
+                              SM_DIST_UNDEFINED);
+      return;
+   }
+   if (src_sm == &sm_distinguished[SM_DIST_DEFINED]) {
+      set_address_range_perms(dst, len, VA_BITS16_DEFINED, SM_DIST_DEFINED);
+      return;
+   }
+
+   // Get dst's secmap first: making it writable may replace the secmap
+   // src lives in, if they are the same.
+   dst_sm = get_secmap_for_writing(dst);
+   src_sm = get_secmap_for_reading(src);
+   s8     = &(src_sm->vabits8[SM_OFF(src)]);
+   VG_(memcpy)( &(dst_sm->vabits8[SM_OFF(dst)]), s8, n8 );
+
+   k = 0;
+   while (k < n8) {
+      if (VG_IS_WORD_ALIGNED(&s8[k]) && n8 - k >= sizeof(UWord)) {
+         UWord w = *(UWord*)&s8[k];
+         if (LIKELY(0 == (w & (w >> 1) & VA_BITSW_UNDEFINED))) {
+            k += sizeof(UWord);
+            continue;
+         }
+      }
+      if (UNLIKELY(s8[k] & (s8[k] >> 1) & VA_BITS8_UNDEFINED)) {
+         /* have to copy secondary map info */
+         for (j = 4*k; j < 4*k + 4; j++) {
+            if (VA_BITS2_PARTDEFINED == get_vabits2( src+j ))
+               set_sec_vbits8( dst+j, get_sec_vbits8( src+j ) );
+         }
+      }
+      k++;
+   }
+}
+
 void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 {
    SizeT i, j;
-   UChar vabits2, vabits8;
+   UChar vabits2;
    Bool  aligned, nooverlap;
 
    DEBUG("MC_(copy_address_range_state)\n");
@@ -1917,29 +2206,19 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
 
    if (nooverlap && aligned) {
 
-      /* Vectorised fast case, when no overlap and suitably aligned */
-      /* vector loop */
+      /* Fast case, when no overlap and suitably aligned: copy as much
+         as lies within the current src and dst secmaps in one go. */
       i = 0;
       while (len >= 4) {
-         vabits8 = get_vabits8_for_aligned_word32( src+i );
-         set_vabits8_for_aligned_word32( dst+i, vabits8 );
-         if (LIKELY(VA_BITS8_DEFINED == vabits8 
-                            || VA_BITS8_UNDEFINED == vabits8 
-                            || VA_BITS8_NOACCESS == vabits8)) {
-            /* do nothing */
-         } else {
-            /* have to copy secondary map info */
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+0 ))
-               set_sec_vbits8( dst+i+0, get_sec_vbits8( src+i+0 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+1 ))
-               set_sec_vbits8( dst+i+1, get_sec_vbits8( src+i+1 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+2 ))
-               set_sec_vbits8( dst+i+2, get_sec_vbits8( src+i+2 ) );
-            if (VA_BITS2_PARTDEFINED == get_vabits2( src+i+3 ))
-               set_sec_vbits8( dst+i+3, get_sec_vbits8( src+i+3 ) );
-         }
-         i += 4;
-         len -= 4;
+         SizeT run = len;
+         if (run > SM_SIZE - ((src+i) & SM_MASK))
+            run = SM_SIZE - ((src+i) & SM_MASK);
+         if (run > SM_SIZE - ((dst+i) & SM_MASK))
+            run = SM_SIZE - ((dst+i) & SM_MASK);
+         run = VG_ROUNDDN(run, 4);
+         copy_vabits_within_sm( src+i, dst+i, run );
+         i   += run;
+         len -= run;
       }
       /* fixup loop */
       while (len >= 1) {
@@ -2076,7 +2355,7 @@ void MC_(copy_address_range_state) ( Addr src, Addr dst, SizeT len )
    zeroes to be installed.  However, ejecting a line containing
    nonzeroes risks losing origin information permanently.  In order to
    prevent such lossage, ejected nonzero lines are placed in a
-   secondary cache (ocacheL2), which is an OSet (AVL tree) of cache
+   secondary cache (ocacheL2), which is a hash table of cache
    lines.  This can grow arbitrarily large, and so should ensure that
    Memcheck runs out of memory in preference to losing useful origin
    info due to cache size limitations.
@@ -2412,65 +2691,141 @@ static void zeroise_OCacheLine ( OCacheLine* line, Addr tag ) {
 //////////////////////////////////////////////////////////////
 //// OCache backing store
 
-static OSet* ocacheL2 = NULL;
+/* The backing store is an open-addressed hash table of lines, keyed
+   by tag and using linear probing.  Unused slots have tag 1 (invalid),
+   as in ocacheL1.  It holds only lines which contain at least one real
+   origin; the ones that don't are equivalent to a missing line.  This
+   used to be an OSet, but for programs with a lot of origins that made
+   every ocacheL1 miss a walk down a deep tree.  Here a lookup usually
+   touches only one or two cache lines. */
+
+static OCacheLine* ocacheL2 = NULL;
+
+/* Number of slots in ocacheL2; always a power of 2.  The table is
+   doubled in size when it becomes half full. */
+#define OC_L2_INIT_SLOTS_BITS 16
+static UWord ocacheL2_n_slots = 0;
+/* Number of bits in a word minus log2(ocacheL2_n_slots). */
+static UInt  ocacheL2_hash_shift = 0;
+
+/* Stats: # nodes currently in the table, # probes done to find a
+   tag or a free slot, # times the table has been resized. */
+static UWord stats__ocacheL2_n_nodes = 0;
+static UWord stats__ocacheL2_probes  = 0;
+static UWord stats__ocacheL2_resizes = 0;
 
-static void* ocacheL2_malloc ( const HChar* cc, SizeT szB ) {
-   return VG_(malloc)(cc, szB);
-}
-static void ocacheL2_free ( void* v ) {
-   VG_(free)( v );
+/* Fibonacci hashing: take the top bits of the line number multiplied
+   by 2^wordsize/phi. */
+static INLINE UWord ocacheL2_hash ( Addr tag )
+{
+#  if VG_WORDSIZE == 8
+   const UWord mul = 0x9E3779B97F4A7C15ULL;
+#  else
+   const UWord mul = 0x9E3779B9UL;
+#  endif
+   return ((tag >> OC_BITS_PER_LINE) * mul) >> ocacheL2_hash_shift;
 }
 
-/* Stats: # nodes currently in tree */
-static UWord stats__ocacheL2_n_nodes = 0;
+static void ocacheL2_alloc_slots ( UInt n_slots_bits )
+{
+   UWord i;
+   ocacheL2_n_slots    = (UWord)1 << n_slots_bits;
+   ocacheL2_hash_shift = 8 * sizeof(UWord) - n_slots_bits;
+   ocacheL2 = VG_(malloc)( "mc.ioL2", ocacheL2_n_slots * sizeof(OCacheLine) );
+   for (i = 0; i < ocacheL2_n_slots; i++)
+      ocacheL2[i].tag = 1/*invalid*/;
+}
 
 static void init_ocacheL2 ( void )
 {
    tl_assert(!ocacheL2);
-   tl_assert(sizeof(Word) == sizeof(Addr)); /* since OCacheLine.tag :: Addr */
-   tl_assert(0 == offsetof(OCacheLine,tag));
-   ocacheL2 
-      = VG_(OSetGen_Create)( offsetof(OCacheLine,tag), 
-                             NULL, /* fast cmp */
-                             ocacheL2_malloc, "mc.ioL2", ocacheL2_free);
+   ocacheL2_alloc_slots( OC_L2_INIT_SLOTS_BITS );
    stats__ocacheL2_n_nodes = 0;
 }
 
-/* Find line with the given tag in the tree, or NULL if not found. */
+/* Return the index of the slot holding 'tag', or of the unused slot
+   where it would go if it isn't present. */
+static INLINE UWord ocacheL2_find_slot ( Addr tag )
+{
+   UWord mask = ocacheL2_n_slots - 1;
+   UWord i    = ocacheL2_hash(tag);
+   while (ocacheL2[i].tag != tag && ocacheL2[i].tag != 1/*invalid*/) {
+      stats__ocacheL2_probes++;
+      i = (i + 1) & mask;
+   }
+   return i;
+}
+
+/* Double the size of the table. */
+static void ocacheL2_grow ( void )
+{
+   OCacheLine* old         = ocacheL2;
+   UWord       old_n_slots = ocacheL2_n_slots;
+   UWord       i;
+
+   stats__ocacheL2_resizes++;
+   ocacheL2_alloc_slots( 8 * sizeof(UWord) - ocacheL2_hash_shift + 1 );
+   for (i = 0; i < old_n_slots; i++) {
+      if (old[i].tag != 1/*invalid*/)
+         ocacheL2[ocacheL2_find_slot(old[i].tag)] = old[i];
+   }
+   VG_(free)(old);
+}
+
+/* Find line with the given tag in the table, or NULL if not found.
+   The result is only valid until the next ocacheL2_del_tag or
+   ocacheL2_add_line, since those move lines around. */
 static OCacheLine* ocacheL2_find_tag ( Addr tag )
 {
-   OCacheLine* line;
+   UWord i;
    tl_assert(is_valid_oc_tag(tag));
    stats__ocacheL2_refs++;
-   line = VG_(OSetGen_Lookup)( ocacheL2, &tag );
-   return line;
+   i = ocacheL2_find_slot(tag);
+   return ocacheL2[i].tag == tag ? &ocacheL2[i] : NULL;
 }
 
-/* Delete the line with the given tag from the tree, if it is present, and
-   free up the associated memory. */
+/* Delete the line with the given tag from the table, if it is
+   present.  Deletion shifts later lines of the probe sequence back, so
+   that lookups never need to skip over deleted slots. */
 static void ocacheL2_del_tag ( Addr tag )
 {
-   OCacheLine* line;
+   UWord mask = ocacheL2_n_slots - 1;
+   UWord i, j, k;
    tl_assert(is_valid_oc_tag(tag));
    stats__ocacheL2_refs++;
-   line = VG_(OSetGen_Remove)( ocacheL2, &tag );
-   if (line) {
-      VG_(OSetGen_FreeNode)(ocacheL2, line);
-      tl_assert(stats__ocacheL2_n_nodes > 0);
-      stats__ocacheL2_n_nodes--;
+   i = ocacheL2_find_slot(tag);
+   if (ocacheL2[i].tag != tag)
+      return;
+   tl_assert(stats__ocacheL2_n_nodes > 0);
+   stats__ocacheL2_n_nodes--;
+   j = i;
+   while (True) {
+      j = (j + 1) & mask;
+      if (ocacheL2[j].tag == 1/*invalid*/)
+         break;
+      /* The line in slot j can be moved to the hole at i unless its
+         home slot k lies cyclically in (i, j]. */
+      k = ocacheL2_hash(ocacheL2[j].tag);
+      if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+         continue;
+      ocacheL2[i] = ocacheL2[j];
+      i = j;
    }
+   ocacheL2[i].tag = 1/*invalid*/;
 }
 
-/* Add a copy of the given line to the tree.  It must not already be
+/* Add a copy of the given line to the table.  It must not already be
    present. */
 static void ocacheL2_add_line ( OCacheLine* line )
 {
-   OCacheLine* copy;
+   UWord i;
    tl_assert(is_valid_oc_tag(line->tag));
-   copy = VG_(OSetGen_AllocNode)( ocacheL2, sizeof(OCacheLine) );
-   *copy = *line;
    stats__ocacheL2_refs++;
-   VG_(OSetGen_Insert)( ocacheL2, copy );
+   if (2 * (stats__ocacheL2_n_nodes + 1) > ocacheL2_n_slots)
+      ocacheL2_grow();
+   i = ocacheL2_find_slot(line->tag);
+   tl_assert(ocacheL2[i].tag == 1/*invalid*/);
+   ocacheL2[i] = *line;
    stats__ocacheL2_n_nodes++;
    if (stats__ocacheL2_n_nodes > stats__ocacheL2_n_nodes_max)
       stats__ocacheL2_n_nodes_max = stats__ocacheL2_n_nodes;
@@ -4058,6 +4413,54 @@ static Bool is_mem_addressable ( Addr a, SizeT len,
    return True;
 }
 
+/* Returns the length of the longest prefix of [a, a+len) in which all
+   bytes are addressable and defined, rounded down to a multiple of 4.
+   'a' must be 4-aligned.  Whole defined DSMs are skipped without looking
+   at them, and other secmaps are scanned a word of vabits8 entries at a
+   time.  Used to get the common all-defined case through is_mem_defined
+   and is_mem_defined_comprehensive quickly; they deal with whatever
+   follows the prefix a byte at a time. */
+static SizeT defined_prefix_len ( Addr a, SizeT len )
+{
+   SizeT n = 0;
+
+   while (len - n >= 4) {
+      Addr    an  = a + n;
+      SizeT   run = SM_SIZE - (an & SM_MASK);
+      SecMap* sm  = get_secmap_for_reading(an);
+      UChar*  v8;
+      SizeT   n8, k;
+
+      if (run > len - n)
+         run = VG_ROUNDDN(len - n, 4);
+      if (sm == &sm_distinguished[SM_DIST_DEFINED]) {
+         n += run;
+         continue;
+      }
+      if (sm == &sm_distinguished[SM_DIST_NOACCESS]
+          || sm == &sm_distinguished[SM_DIST_UNDEFINED])
+         break;
+
+      v8 = &(sm->vabits8[SM_OFF(an)]);
+      n8 = run >> 2;
+      k  = 0;
+      while (k < n8) {
+         if (VG_IS_WORD_ALIGNED(&v8[k]) && n8 - k >= sizeof(UWord)
+             && *(UWord*)&v8[k] == VA_BITSW_DEFINED) {
+            k += sizeof(UWord);
+            continue;
+         }
+         if (v8[k] != VA_BITS8_DEFINED)
+            break;
+         k++;
+      }
+      n += k << 2;
+      if (k < n8)
+         break;
+   }
+   return n;
+}
+
 static MC_ReadResult is_mem_defined ( Addr a, SizeT len,
                                       /*OUT*/Addr* bad_addr,
                                       /*OUT*/UInt* otag )
@@ -4071,6 +4474,12 @@ static MC_ReadResult is_mem_defined ( Addr a, SizeT len,
    if (otag)     *otag = 0;
    if (bad_addr) *bad_addr = 0;
    for (i = 0; i < len; i++) {
+      if (VG_IS_4_ALIGNED(a)) {
+         SizeT n = defined_prefix_len(a, len - i);
+         a += n;
+         i += n;
+         if (i == len) break;
+      }
       PROF_EVENT(MCPE_IS_MEM_DEFINED_LOOP);
       vabits2 = get_vabits2(a);
       if (VA_BITS2_DEFINED != vabits2) {
@@ -4124,6 +4533,12 @@ static void is_mem_defined_comprehensive (
    tl_assert(!(*errorV || *errorA));
 
    for (i = 0; i < len; i++) {
+      if (VG_IS_4_ALIGNED(a)) {
+         SizeT n = defined_prefix_len(a, len - i);
+         a += n;
+         i += n;
+         if (i == len) break;
+      }
       PROF_EVENT(MCPE_IS_MEM_DEFINED_COMPREHENSIVE_LOOP);
       vabits2 = get_vabits2(a);
       switch (vabits2) {
@@ -4333,6 +4748,7 @@ static
 void mc_new_mem_mmap ( Addr a, SizeT len, Bool rr, Bool ww, Bool xx,
                        ULong di_handle )
 {
+   MC_(maybe_dedup_secmaps)();
    if (rr || ww || xx) {
       /* (2) mmap/mprotect other -> defined */
       MC_(make_mem_defined)(a, len);
@@ -4695,6 +5111,26 @@ STATIC_ASSERT(V_BITS8_UNDEFINED == 0xFF);
            = 0xFFFF'FFF0'0000'0007
 */
 
+/* With --inline-loadv=yes, mc_translate.c generates IR for the fast
+   paths of LOADV32/64 and STOREV32/64 below, and only calls the
+   helpers when those fail.  This is what it needs to know to do so. */
+
+Addr MC_(inline_primary_map) ( void )
+{
+   return (Addr)&primary_map[0];
+}
+
+UWord MC_(inline_primary_map_mask) ( void )
+{
+   return N_PRIMARY_MAP - 1;
+}
+
+UWord MC_(inline_fast_access_mask) ( Int szB )
+{
+   tl_assert(szB == 4 || szB == 8);
+   return MASK(szB);
+}
+
 /*------------------------------------------------------------*/
 /*--- LOADV256 and LOADV128                                ---*/
 /*------------------------------------------------------------*/
@@ -5832,11 +6268,8 @@ static void init_shadow_memory ( void )
    for (i = 0; i < N_PRIMARY_MAP; i++)
       primary_map[i] = &sm_distinguished[SM_DIST_NOACCESS];
 
-   /* Auxiliary primary maps */
-   init_auxmap_L1_L2();
-
-   /* auxmap_size = auxmap_used = 0; 
-      no ... these are statically initialised */
+   /* Auxiliary primary map */
+   init_auxmap();
 
    /* Secondary V bit table */
    secVBitTable = createSecVBitTable();
@@ -5862,6 +6295,7 @@ static Bool mc_expensive_sanity_check ( void )
 {
    Int     i;
    Word    n_secmaps_found;
+   Word    n_shared_refs_found = 0;
    SecMap* sm;
    const HChar*  errmsg;
    Bool    bad = False;
@@ -5911,7 +6345,7 @@ static Bool mc_expensive_sanity_check ( void )
 
    /* check the auxiliary maps, very thoroughly */
    n_secmaps_found = 0;
-   errmsg = check_auxmap_L1_L2_sanity( &n_secmaps_found );
+   errmsg = check_auxmap_sanity( &n_secmaps_found );
    if (errmsg) {
       VG_(printf)("memcheck expensive sanity, auxmaps:\n\t%s", errmsg);
       return False;
@@ -5926,6 +6360,8 @@ static Bool mc_expensive_sanity_check ( void )
       } else {
          if (!is_distinguished_sm(primary_map[i]))
             n_secmaps_found++;
+         else if (is_shared_sm(primary_map[i]))
+            n_shared_refs_found++;
       }
    }
 
@@ -5940,6 +6376,23 @@ static Bool mc_expensive_sanity_check ( void )
       return False;
    }
 
+   /* check that the shared secmaps' reference counts add up (only the
+      main primary map refers to shared secmaps) */
+   if (MC_(clo_dedup_secmaps)) {
+      Word n_refs = 0, n_in_use = 0;
+      for (i = 0; i < N_SM_SHARED; i++) {
+         n_refs += sm_shared_refcount[i];
+         if (sm_shared_refcount[i] > 0)
+            n_in_use++;
+      }
+      if (n_refs != n_shared_refs_found || n_refs != n_shared_SM_refs
+          || n_in_use != n_shared_SMs) {
+         VG_(printf)("memcheck expensive sanity: "
+                     "shared secmap reference counts are wrong\n");
+         return False;
+      }
+   }
+
    if (bad) {
       VG_(printf)("memcheck expensive sanity: "
                   "auxmap covers wrong address space\n");
@@ -5976,6 +6429,8 @@ KeepStacktraces MC_(clo_keep_stacktraces)     = KS_alloc_and_free;
 Int           MC_(clo_mc_level)               = 2;
 Bool          MC_(clo_show_mismatched_frees)  = True;
 Bool          MC_(clo_expensive_definedness_checks) = False;
+Bool          MC_(clo_dedup_secmaps)          = False;
+Bool          MC_(clo_inline_loadv)           = False;
 
 static const HChar * MC_(parse_leak_heuristics_tokens) =
    "-,stdstring,length64,newarray,multipleinheritance";
@@ -6124,6 +6579,10 @@ static Bool mc_process_cmd_line_options(const HChar* arg)
                        MC_(clo_show_mismatched_frees)) {}
    else if VG_BOOL_CLO(arg, "--expensive-definedness-checks",
                        MC_(clo_expensive_definedness_checks)) {}
+   else if VG_BOOL_CLO(arg, "--dedup-secmaps",
+                       MC_(clo_dedup_secmaps)) {}
+   else if VG_BOOL_CLO(arg, "--inline-loadv",
+                       MC_(clo_inline_loadv)) {}
 
    else
       return VG_(replacement_malloc_process_cmd_line_option)(arg);
@@ -6170,6 +6629,8 @@ static void mc_print_usage(void)
 "    --keep-stacktraces=alloc|free|alloc-and-free|alloc-then-free|none\n"
 "        stack trace(s) to keep for malloc'd/free'd areas       [alloc-and-free]\n"
 "    --show-mismatched-frees=no|yes   show frees that don't match the allocator? [yes]\n"
+"    --dedup-secmaps=no|yes           share identical shadow memory pages [no]\n"
+"    --inline-loadv=no|yes            inline common shadow loads/stores [no]\n"
    );
 }
 
@@ -7655,6 +8116,9 @@ static void ocache_sarp_Clear_Origins ( Addr a, UWord len ) {
 
 static void mc_post_clo_init ( void )
 {
+   if (MC_(clo_dedup_secmaps))
+      init_dedup_secmaps();
+
    /* If we've been asked to emit XML, mash around various other
       options so as to constrain the output somewhat. */
    if (VG_(clo_xml)) {
@@ -7807,20 +8271,12 @@ static void mc_print_stats (void)
       " memcheck: sanity checks: %d cheap, %d expensive\n",
       n_sanity_cheap, n_sanity_expensive );
    VG_(message)(Vg_DebugMsg,
-      " memcheck: auxmaps: %llu auxmap entries (%lluk, %lluM) in use\n",
-      n_auxmap_L2_nodes, 
-      n_auxmap_L2_nodes * 64, 
-      n_auxmap_L2_nodes / 16 );
-   VG_(message)(Vg_DebugMsg,
-      " memcheck: auxmaps_L1: %llu searches, %llu cmps, ratio %llu:10\n",
-      n_auxmap_L1_searches, n_auxmap_L1_cmps,
-      (10ULL * n_auxmap_L1_cmps) 
-         / (n_auxmap_L1_searches ? n_auxmap_L1_searches : 1) 
-   );   
+      " memcheck: auxmaps: %llu L2 tables, %llu L3 tables (%lluM) in use\n",
+      n_auxmap_L2_tables, n_auxmap_L3_tables,
+      n_auxmap_L3_tables * sizeof(AuxMapL3) / (1024 * 1024UL) );
    VG_(message)(Vg_DebugMsg,
-      " memcheck: auxmaps_L2: %llu searches, %llu nodes\n",
-      n_auxmap_L2_searches, n_auxmap_L2_nodes
-   );   
+      " memcheck: auxmaps: %llu searches\n",
+      n_auxmap_searches );
 
    print_SM_info("n_issued     ", n_issued_SMs);
    print_SM_info("n_deissued   ", n_deissued_SMs);
@@ -7828,6 +8284,14 @@ static void mc_print_stats (void)
    print_SM_info("max_undefined", max_undefined_SMs);
    print_SM_info("max_defined  ", max_defined_SMs);
    print_SM_info("max_non_DSM  ", max_non_DSM_SMs);
+   if (MC_(clo_dedup_secmaps)) {
+      print_SM_info("n_shared     ", n_shared_SMs);
+      print_SM_info("max_shared   ", max_shared_SMs);
+      VG_(message)(Vg_DebugMsg,
+         " memcheck: SMs: %d references to shared SMs; dedup made %llu "
+         "distinguished, %llu shared\n",
+         n_shared_SM_refs, n_dedup_to_DSM, n_dedup_to_shared);
+   }
 
    // Three DSMs, plus the non-DSM ones
    max_SMs_szB = (3 + max_non_DSM_SMs) * sizeof(SecMap);
@@ -7881,6 +8345,11 @@ static void mc_print_stats (void)
                    " ocacheL2:    %'9lu max nodes %'9lu curr nodes\n",
                    stats__ocacheL2_n_nodes_max,
                    stats__ocacheL2_n_nodes );
+      VG_(message)(Vg_DebugMsg,
+                   " ocacheL2:    %'9lu slots     %'9lu probes (%lu resizes)\n",
+                   ocacheL2_n_slots,
+                   stats__ocacheL2_probes,
+                   stats__ocacheL2_resizes );
       VG_(message)(Vg_DebugMsg,
                    " niacache: %'12lu refs   %'12lu misses\n",
                    stats__nia_cache_queries, stats__nia_cache_misses);
@@ -38,6 +38,7 @@
 #include "pub_tool_libcprint.h"
 #include "pub_tool_mallocfree.h"
 #include "pub_tool_options.h"
+#include "pub_tool_oset.h"
 #include "pub_tool_replacemalloc.h"
 #include "pub_tool_threadstate.h"
 #include "pub_tool_tooliface.h"     // Needed for mc_include.h
@@ -93,6 +94,113 @@ void delete_MC_Chunk (MC_Chunk* mc);
    position [0] is for big blocks, [1] is for small blocks. */
 static MC_Chunk* freed_list_start[2]  = {NULL, NULL};
 static MC_Chunk* freed_list_end[2]    = {NULL, NULL};
+/* The position of the first and last block of each freed list.  The
+   blocks of a list have consecutive positions, in list order. */
+static Long freed_list_start_seq[2]   = {0, 0};
+static Long freed_list_end_seq[2]     = {-1, -1};
+
+/* An index of the freed lists, so that the freed block bracketting an
+   address can be found without walking the lists.  As the index is
+   only needed to describe addresses in error messages, it is only
+   built by the first MC_(get_freed_block_bracketting) call, and
+   maintained from then on; programs without errors don't pay for it.
+
+   The blocks are split in size classes: class c holds the blocks with
+   a size in [2^c, 2^(c+1)) (and class 0 also the empty ones).  Within a
+   class, blocks are ordered on their address.  A block of class c can
+   only bracket 'a' if it starts in (a - 2^(c+1) - redzone, a + redzone],
+   and in that window there are only a few blocks of class c, as
+   blocks of that size that are all waiting to be freed can't overlap
+   much.  So a lookup costs a logarithmic search per non-empty class. */
+#define FQ_N_CLASSES (sizeof(SizeT) * 8)
+
+typedef
+   struct {
+      Addr data;  // Address of the block,
+      Int  l;     // which freed list it is on,
+      Long seq;   // and its position in that list.
+   }
+   FreedKey;
+
+typedef
+   struct {
+      FreedKey  key;
+      MC_Chunk* mc;
+   }
+   FreedNode;
+
+static Bool  freed_index_built = False;
+static OSet* freed_index[FQ_N_CLASSES];
+
+static Word cmp_FreedKey ( const void* key, const void* elem )
+{
+   const FreedKey* k1 = key;
+   const FreedKey* k2 = &((const FreedNode*)elem)->key;
+
+   if (k1->data < k2->data) return -1;
+   if (k1->data > k2->data) return  1;
+   if (k1->l    < k2->l)    return -1;
+   if (k1->l    > k2->l)    return  1;
+   if (k1->seq  < k2->seq)  return -1;
+   if (k1->seq  > k2->seq)  return  1;
+   return 0;
+}
+
+static UInt freed_index_class ( SizeT szB )
+{
+   UInt c = 0;
+   while (c < FQ_N_CLASSES-1 && (szB >> (c+1)) != 0)
+      c++;
+   return c;
+}
+
+static void freed_index_add ( MC_Chunk* mc, Int l, Long seq )
+{
+   UInt       c = freed_index_class(mc->szB);
+   FreedNode* n;
+
+   if (freed_index[c] == NULL)
+      freed_index[c] = VG_(OSetGen_Create_With_Pool)
+                          (offsetof(FreedNode, key), cmp_FreedKey,
+                           VG_(malloc), "mc.fia.1", VG_(free),
+                           256, sizeof(FreedNode));
+   n = VG_(OSetGen_AllocNode)(freed_index[c], sizeof(FreedNode));
+   n->key.data = mc->data;
+   n->key.l    = l;
+   n->key.seq  = seq;
+   n->mc       = mc;
+   VG_(OSetGen_Insert)(freed_index[c], n);
+}
+
+static void freed_index_remove ( MC_Chunk* mc, Int l, Long seq )
+{
+   UInt       c = freed_index_class(mc->szB);
+   FreedKey   k;
+   FreedNode* n;
+
+   k.data = mc->data;
+   k.l    = l;
+   k.seq  = seq;
+   n = VG_(OSetGen_Remove)(freed_index[c], &k);
+   tl_assert(n != NULL && n->mc == mc);
+   VG_(OSetGen_FreeNode)(freed_index[c], n);
+}
+
+static void build_freed_index ( void )
+{
+   Int       l;
+   Long      seq;
+   MC_Chunk* mc;
+
+   tl_assert(!freed_index_built);
+   for (l = 0; l < 2; l++) {
+      seq = freed_list_start_seq[l];
+      for (mc = freed_list_start[l]; mc != NULL; mc = mc->next)
+         freed_index_add(mc, l, seq++);
+      tl_assert(seq == freed_list_end_seq[l] + 1);
+   }
+   freed_index_built = True;
+}
 
 /* Put a shadow chunk on the freed blocks queue, possibly freeing up
    some of the oldest blocks in the queue at the same time. */
@@ -100,6 +208,7 @@ static void add_to_freed_queue ( MC_Chunk* mc )
 {
    const Bool show = False;
    const int l = (mc->szB >= MC_(clo_freelist_big_blocks) ? 0 : 1);
+   Long seq;
 
    /* Put it at the end of the freed list, unless the block
       would be directly released any way : in this case, we
@@ -108,17 +217,23 @@ static void add_to_freed_queue ( MC_Chunk* mc )
       tl_assert(freed_list_start[l] == NULL);
       mc->next = NULL;
       freed_list_end[l]    = freed_list_start[l] = mc;
+      seq = freed_list_start_seq[l] = freed_list_end_seq[l] + 1;
+      freed_list_end_seq[l] = seq;
    } else {
       tl_assert(freed_list_end[l]->next == NULL);
       if (mc->szB >= MC_(clo_freelist_vol)) {
          mc->next = freed_list_start[l];
          freed_list_start[l] = mc;
+         seq = --freed_list_start_seq[l];
       } else {
          mc->next = NULL;
          freed_list_end[l]->next = mc;
          freed_list_end[l]       = mc;
+         seq = ++freed_list_end_seq[l];
       }
    }
+   if (freed_index_built)
+      freed_index_add(mc, l, seq);
    VG_(free_queue_volume) += (Long)mc->szB;
    if (show)
       VG_(printf)("mc_freelist: acquire: volume now %lld\n", 
@@ -153,11 +268,14 @@ static void release_oldest_block(void)
                         VG_(free_queue_volume));
          tl_assert(VG_(free_queue_volume) >= 0);
          
+         if (freed_index_built)
+            freed_index_remove(mc1, i, freed_list_start_seq[i]);
          if (freed_list_start[i] == freed_list_end[i]) {
             freed_list_start[i] = freed_list_end[i] = NULL;
          } else {
             freed_list_start[i] = mc1->next;
          }
+         freed_list_start_seq[i]++;
          mc1->next = NULL; /* just paranoia */
 
          /* free MC_Chunk */
@@ -168,20 +286,39 @@ static void release_oldest_block(void)
    }
 }
 
+/* Returns the first block, in freed lists order, that brackets a. */
 MC_Chunk* MC_(get_freed_block_bracketting) (Addr a)
 {
-   int i;
-   for (i = 0; i < 2; i++) {
-      MC_Chunk*  mc;
-      mc = freed_list_start[i];
-      while (mc) {
-         if (VG_(addr_is_in_block)( a, mc->data, mc->szB,
-                                    MC_(Malloc_Redzone_SzB) ))
-            return mc;
-         mc = mc->next;
+   const SizeT rz   = MC_(Malloc_Redzone_SzB);
+   FreedNode*  best = NULL;
+   FreedNode*  n;
+   FreedKey    k;
+   SizeT       span;
+   UInt        c;
+
+   if (!freed_index_built)
+      build_freed_index();
+
+   for (c = 0; c < FQ_N_CLASSES; c++) {
+      if (freed_index[c] == NULL || VG_(OSetGen_Size)(freed_index[c]) == 0)
+         continue;
+      // Blocks of class c are smaller than span bytes.
+      span = c < FQ_N_CLASSES-1 ? (SizeT)2 << c : ~(SizeT)0;
+      k.data = a > span + rz ? a - span - rz : 0;
+      k.l    = -1;  // before any block at k.data
+      k.seq  = 0;
+      VG_(OSetGen_ResetIterAt)(freed_index[c], &k);
+      while ( (n = VG_(OSetGen_Next)(freed_index[c])) ) {
+         if (n->key.data > a && n->key.data - a > rz)
+            break;
+         if (VG_(addr_is_in_block)( a, n->mc->data, n->mc->szB, rz )
+             && (best == NULL
+                 || n->key.l < best->key.l
+                 || (n->key.l == best->key.l && n->key.seq < best->key.seq)))
+            best = n;
       }
    }
-   return NULL;
+   return best ? best->mc : NULL;
 }
 
 /* Allocate a shadow chunk, put it on the appropriate list.
@@ -342,6 +479,8 @@ void* MC_(new_block) ( ThreadId tid,
 {
    MC_Chunk* mc;
 
+   MC_(maybe_dedup_secmaps)();
+
    // Allocate and zero if necessary
    if (p) {
       tl_assert(MC_AllocCustom == kind);
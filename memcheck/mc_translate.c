@@ -160,6 +160,13 @@ static IRExpr *i128_const_zero(void);
    When .kind is VSh or BSh then the tmp is holds a V- or B- value,
    and so .shadowV and .shadowB must be IRTemp_INVALID, since it is
    illogical for a shadow tmp itself to be shadowed.
+
+   .definedV is only meaningful for Orig tmps.  It is True when the
+   current .shadowV is known to be all-defined at every point from here
+   on in the superblock: either the tmp was computed purely from
+   defined values, or it has already been checked by
+   complainIfUndefined.  Checking it again can never produce an error,
+   so such checks are not generated.
 */
 typedef
    enum { Orig=1, VSh=2, BSh=3 }
@@ -170,6 +177,7 @@ typedef
       TempKind kind;
       IRTemp   shadowV;
       IRTemp   shadowB;
+      Bool     definedV;
    }
    TempMapEnt;
 
@@ -216,6 +224,10 @@ typedef
          arguments of type 'HWord' to be passed to helper functions.
          Ity_I32 or Ity_I64 only. */
       IRType hWordTy;
+
+      /* READONLY: the host endianness, for loads from shadow memory
+         done by inline code (--inline-loadv=yes). */
+      IREndness hEnd;
    }
    MCEnv;
 
@@ -252,9 +264,10 @@ static IRTemp newTemp ( MCEnv* mce, IRType ty, TempKind kind )
    Word       newIx;
    TempMapEnt ent;
    IRTemp     tmp = newIRTemp(mce->sb->tyenv, ty);
-   ent.kind    = kind;
-   ent.shadowV = IRTemp_INVALID;
-   ent.shadowB = IRTemp_INVALID;
+   ent.kind     = kind;
+   ent.shadowV  = IRTemp_INVALID;
+   ent.shadowB  = IRTemp_INVALID;
+   ent.definedV = False;
    newIx = VG_(addToXA)( mce->tmpMap, &ent );
    tl_assert(newIx == (Word)tmp);
    return tmp;
@@ -307,10 +320,27 @@ static void newShadowTmpV ( MCEnv* mce, IRTemp orig )
          from VG_(indexXA) are invalid. */
       ent = (TempMapEnt*)VG_(indexXA)( mce->tmpMap, (Word)orig );
       tl_assert(ent->kind == Orig);
-      ent->shadowV = tmpV;
+      ent->shadowV  = tmpV;
+      ent->definedV = False;
    }
 }
 
+/* Is the shadow of the given original tmp known to be all-defined?
+   See comments on TempMapEnt. */
+static Bool isShadowTmpVDefined ( MCEnv* mce, IRTemp orig )
+{
+   TempMapEnt* ent = (TempMapEnt*)VG_(indexXA)( mce->tmpMap, (Word)orig );
+   tl_assert(ent->kind == Orig);
+   return ent->definedV;
+}
+
+static void setShadowTmpVDefined ( MCEnv* mce, IRTemp orig )
+{
+   TempMapEnt* ent = (TempMapEnt*)VG_(indexXA)( mce->tmpMap, (Word)orig );
+   tl_assert(ent->kind == Orig);
+   ent->definedV = True;
+}
+
 
 /*------------------------------------------------------------*/
 /*--- IRAtoms -- a subset of IRExprs                       ---*/
@@ -362,6 +392,56 @@ static Bool sameKindedAtoms ( IRAtom* a1, IRAtom* a2 )
    return False;
 }
 
+/* Is this original atom known to be all-defined?  Literals always
+   are; tmps are if so recorded in the tmp map. */
+static Bool isDefinedAtom ( MCEnv* mce, IRAtom* a1 )
+{
+   tl_assert(isOriginalAtom(mce, a1));
+   if (a1->tag == Iex_Const)
+      return True;
+   return isShadowTmpVDefined(mce, a1->Iex.RdTmp.tmp);
+}
+
+/* Is the result of this original (flat) expression known to be
+   all-defined?  That is so for the pure operations, if all of their
+   arguments are: the V bit propagation rules never make anything
+   undefined out of defined inputs.  Values read from memory or the
+   guest state are never known to be defined. */
+static Bool isDefinedExpr ( MCEnv* mce, IRExpr* e )
+{
+   Int i;
+   switch (e->tag) {
+      case Iex_Const:
+      case Iex_RdTmp:
+         return isDefinedAtom(mce, e);
+      case Iex_Unop:
+         return isDefinedAtom(mce, e->Iex.Unop.arg);
+      case Iex_Binop:
+         return isDefinedAtom(mce, e->Iex.Binop.arg1)
+                && isDefinedAtom(mce, e->Iex.Binop.arg2);
+      case Iex_Triop:
+         return isDefinedAtom(mce, e->Iex.Triop.details->arg1)
+                && isDefinedAtom(mce, e->Iex.Triop.details->arg2)
+                && isDefinedAtom(mce, e->Iex.Triop.details->arg3);
+      case Iex_Qop:
+         return isDefinedAtom(mce, e->Iex.Qop.details->arg1)
+                && isDefinedAtom(mce, e->Iex.Qop.details->arg2)
+                && isDefinedAtom(mce, e->Iex.Qop.details->arg3)
+                && isDefinedAtom(mce, e->Iex.Qop.details->arg4);
+      case Iex_ITE:
+         return isDefinedAtom(mce, e->Iex.ITE.cond)
+                && isDefinedAtom(mce, e->Iex.ITE.iftrue)
+                && isDefinedAtom(mce, e->Iex.ITE.iffalse);
+      case Iex_CCall:
+         for (i = 0; e->Iex.CCall.args[i]; i++)
+            if (!isDefinedAtom(mce, e->Iex.CCall.args[i]))
+               return False;
+         return True;
+      default:
+         return False;
+   }
+}
+
 
 /*------------------------------------------------------------*/
 /*--- Type management                                      ---*/
@@ -1239,6 +1319,13 @@ static void complainIfUndefined ( MCEnv* mce, IRAtom* atom, IRExpr *guard )
    if (guard)
       tl_assert(isOriginalAtom(mce, guard));
 
+   /* If |atom| is already known to be defined, the check can never
+      fail, so don't bother generating it.  That's the case for
+      literals, for tmps that have already been checked earlier in
+      this superblock, and for tmps computed only from such. */
+   if (isDefinedAtom(mce, atom))
+      return;
+
    /* Since the original expression is atomic, there's no duplicated
       work generated by making multiple V-expressions for it.  So we
       don't really care about the possibility that someone else may
@@ -1381,6 +1468,7 @@ static void complainIfUndefined ( MCEnv* mce, IRAtom* atom, IRExpr *guard )
          newShadowTmpV(mce, atom->Iex.RdTmp.tmp);
          assign('V', mce, findShadowTmpV(mce, atom->Iex.RdTmp.tmp), 
                           definedOfType(ty));
+         setShadowTmpVDefined(mce, atom->Iex.RdTmp.tmp);
       } else {
          // update the temp only conditionally.  Do this by copying
          // its old value when the guard is False.
@@ -4667,6 +4755,117 @@ IRExpr* expr2vbits_Unop ( MCEnv* mce, IROp op, IRAtom* atom )
 }
 
 
+/* Inline fast paths for LOADV/STOREV.  With --inline-loadv=yes, the
+   32 and 64 bit shadow loads and stores do the common case of
+   MC_(helperc_LOADV32le) etc themselves: an aligned access below
+   MAX_PRIMARY_ADDRESS, to memory whose bytes are either all defined or
+   all undefined.  Only in other cases is the helper called.  This
+   needs 64-bit shadow addresses, since it loads the secondary map
+   pointer from the primary map. */
+static Bool inline_vabits_ok ( MCEnv* mce, IRType ty )
+{
+   return MC_(clo_inline_loadv)
+          && mce->hWordTy == Ity_I64
+          && (ty == Ity_I64 || ty == Ity_I32);
+}
+
+/* Generate IR to look up the VA bits for the SZB (4 or 8) bytes at
+   ADDR, the same way the fast path of mc_LOADV64/mc_LOADV32 does.
+   *ISDEF and *ISUNDEF are set to I32 atoms, which are 1 if the access
+   is fast-path-able and the bytes are respectively all defined or all
+   undefined, and 0 otherwise.  The loads generated here are always
+   safe to do: the primary map index is masked to be in range, and
+   every primary map entry points at some secondary map, distinguished
+   or not. */
+static void gen_inline_vabits ( MCEnv* mce, IRAtom* addr, Int szB,
+                                /*OUT*/IRAtom** isDef,
+                                /*OUT*/IRAtom** isUndef )
+{
+   IRAtom *okAddr, *pmOff, *sm, *smOff, *vabits;
+   UWord  vaDef, vaUndef;
+
+   tl_assert(mce->hWordTy == Ity_I64);
+   tl_assert(szB == 4 || szB == 8);
+
+   okAddr = assignNew('V', mce, Ity_I32,
+               unop(Iop_1Uto32,
+                  assignNew('V', mce, Ity_I1,
+                     binop(Iop_CmpEQ64,
+                           assignNew('V', mce, Ity_I64,
+                              binop(Iop_And64, addr,
+                                    mkU64(MC_(inline_fast_access_mask)(szB)))),
+                           mkU64(0)))));
+
+   /* sm = primary_map[(addr >> 16) & (N_PRIMARY_MAP-1)] */
+   pmOff = assignNew('V', mce, Ity_I64,
+              binop(Iop_Shl64,
+                    assignNew('V', mce, Ity_I64,
+                       binop(Iop_And64,
+                             assignNew('V', mce, Ity_I64,
+                                binop(Iop_Shr64, addr, mkU8(16))),
+                             mkU64(MC_(inline_primary_map_mask)()))),
+                    mkU8(3)));
+   sm = assignNew('V', mce, Ity_I64,
+           IRExpr_Load(mce->hEnd, Ity_I64,
+              assignNew('V', mce, Ity_I64,
+                 binop(Iop_Add64, mkU64(MC_(inline_primary_map)()),
+                       pmOff))));
+
+   /* The VA bits for SZB bytes are SZB/4 bytes of sm->vabits8. */
+   smOff = assignNew('V', mce, Ity_I64,
+              binop(Iop_Shr64,
+                    assignNew('V', mce, Ity_I64,
+                       binop(Iop_And64, addr, mkU64(0x10000 - szB))),
+                    mkU8(2)));
+   if (szB == 8) {
+      vabits = assignNew('V', mce, Ity_I32,
+                  unop(Iop_16Uto32,
+                     assignNew('V', mce, Ity_I16,
+                        IRExpr_Load(mce->hEnd, Ity_I16,
+                           assignNew('V', mce, Ity_I64,
+                              binop(Iop_Add64, sm, smOff))))));
+      vaDef   = VA_BITS16_DEFINED;
+      vaUndef = VA_BITS16_UNDEFINED;
+   } else {
+      vabits = assignNew('V', mce, Ity_I32,
+                  unop(Iop_8Uto32,
+                     assignNew('V', mce, Ity_I8,
+                        IRExpr_Load(mce->hEnd, Ity_I8,
+                           assignNew('V', mce, Ity_I64,
+                              binop(Iop_Add64, sm, smOff))))));
+      vaDef   = VA_BITS8_DEFINED;
+      vaUndef = VA_BITS8_UNDEFINED;
+   }
+
+   *isDef = assignNew('V', mce, Ity_I32,
+               binop(Iop_And32, okAddr,
+                     assignNew('V', mce, Ity_I32,
+                        unop(Iop_1Uto32,
+                           assignNew('V', mce, Ity_I1,
+                              binop(Iop_CmpEQ32, vabits, mkU32(vaDef)))))));
+   *isUndef = assignNew('V', mce, Ity_I32,
+                 binop(Iop_And32, okAddr,
+                       assignNew('V', mce, Ity_I32,
+                          unop(Iop_1Uto32,
+                             assignNew('V', mce, Ity_I1,
+                                binop(Iop_CmpEQ32, vabits, mkU32(vaUndef)))))));
+}
+
+/* Return an I1 atom which is GUARD && (SLOW != 0), for guarding the
+   helper call that handles the cases the inline code doesn't.  A NULL
+   GUARD means "always True". */
+static IRAtom* guard_for_slow_path ( MCEnv* mce, IRAtom* guard,
+                                     IRAtom* slow )
+{
+   if (guard)
+      slow = assignNew('V', mce, Ity_I32,
+                binop(Iop_And32, slow,
+                      assignNew('V', mce, Ity_I32,
+                         unop(Iop_1Uto32, guard))));
+   return assignNew('V', mce, Ity_I1, binop(Iop_CmpNE32, slow, mkU32(0)));
+}
+
+
 /* Worker function -- do not call directly.  See comments on
    expr2vbits_Load for the meaning of |guard|.
 
@@ -4770,6 +4969,19 @@ IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
       addrAct = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBias) );
    }
 
+   /* With --inline-loadv=yes, find out if the inline code can do the
+      load.  If so, the helper call is skipped. */
+   IRAtom *isDef = NULL, *isUndef = NULL, *fast = NULL;
+   if (!ret_via_outparam && inline_vabits_ok(mce, ty)) {
+      gen_inline_vabits( mce, addrAct, ty == Ity_I64 ? 8 : 4,
+                         &isDef, &isUndef );
+      fast = assignNew('V', mce, Ity_I32, binop(Iop_Or32, isDef, isUndef));
+      guard = guard_for_slow_path(
+                 mce, guard,
+                 assignNew('V', mce, Ity_I32,
+                           binop(Iop_Xor32, fast, mkU32(1))) );
+   }
+
    /* We need to have a place to park the V bits we're just about to
       read. */
    IRTemp datavbits = newTemp(mce, ty, VSh);
@@ -4799,6 +5011,21 @@ IRAtom* expr2vbits_Load_WRK ( MCEnv* mce,
    }
    stmt( 'V', mce, IRStmt_Dirty(di) );
 
+   if (fast) {
+      IRAtom* undef = ty == Ity_I64 ? mkU64(V_BITS64_UNDEFINED)
+                                    : mkU32(V_BITS32_UNDEFINED);
+      IRAtom* inl = assignNew('V', mce, ty,
+                       IRExpr_ITE(
+                          assignNew('V', mce, Ity_I1,
+                                    binop(Iop_CmpNE32, isDef, mkU32(0))),
+                          definedOfType(ty), undef));
+      return assignNew('V', mce, ty,
+                IRExpr_ITE(
+                   assignNew('V', mce, Ity_I1,
+                             binop(Iop_CmpNE32, fast, mkU32(0))),
+                   inl, mkexpr(datavbits)));
+   }
+
    return mkexpr(datavbits);
 }
 
@@ -5301,6 +5528,38 @@ void do_shadow_Store ( MCEnv* mce,
          addrAct = assignNew('V', mce, tyAddr, binop(mkAdd, addr, eBias));
       }
 
+      /* With --inline-loadv=yes, skip the helper call if the store
+         wouldn't change anything: all-defined data going to memory
+         that is all defined, or all-undefined data going to memory
+         that is all undefined. */
+      if (inline_vabits_ok(mce, ty)) {
+         IRAtom *isDef, *isUndef, *vdef, *vundef, *nochange;
+         IROp   opCmpEQ = ty == Ity_I64 ? Iop_CmpEQ64 : Iop_CmpEQ32;
+         gen_inline_vabits( mce, addrAct, ty == Ity_I64 ? 8 : 4,
+                            &isDef, &isUndef );
+         vdef   = assignNew('V', mce, Ity_I32,
+                     unop(Iop_1Uto32,
+                        assignNew('V', mce, Ity_I1,
+                           binop(opCmpEQ, vdata, definedOfType(ty)))));
+         vundef = assignNew('V', mce, Ity_I32,
+                     unop(Iop_1Uto32,
+                        assignNew('V', mce, Ity_I1,
+                           binop(opCmpEQ, vdata,
+                                 ty == Ity_I64
+                                    ? mkU64(V_BITS64_UNDEFINED)
+                                    : mkU32(V_BITS32_UNDEFINED))))));
+         nochange = assignNew('V', mce, Ity_I32,
+                       binop(Iop_Or32,
+                             assignNew('V', mce, Ity_I32,
+                                       binop(Iop_And32, isDef, vdef)),
+                             assignNew('V', mce, Ity_I32,
+                                       binop(Iop_And32, isUndef, vundef))));
+         guard = guard_for_slow_path(
+                    mce, guard,
+                    assignNew('V', mce, Ity_I32,
+                              binop(Iop_Xor32, nochange, mkU32(1))) );
+      }
+
       if (ty == Ity_I64) {
          /* We can't do this with regparm 2 on 32-bit platforms, since
             the back ends aren't clever enough to handle 64-bit
@@ -6366,6 +6625,8 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
    mce.trace          = verboze;
    mce.layout         = layout;
    mce.hWordTy        = hWordTy;
+   mce.hEnd           = archinfo_host->endness == VexEndnessBE
+                           ? Iend_BE : Iend_LE;
    mce.bogusLiterals  = False;
 
    /* Do expensive interpretation for Iop_Add32 and Iop_Add64 on
@@ -6387,9 +6648,10 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
    VG_(hintSizeXA) (mce.tmpMap, sb_in->tyenv->types_used);
    for (i = 0; i < sb_in->tyenv->types_used; i++) {
       TempMapEnt ent;
-      ent.kind    = Orig;
-      ent.shadowV = IRTemp_INVALID;
-      ent.shadowB = IRTemp_INVALID;
+      ent.kind     = Orig;
+      ent.shadowV  = IRTemp_INVALID;
+      ent.shadowB  = IRTemp_INVALID;
+      ent.definedV = False;
       VG_(addToXA)( mce.tmpMap, &ent );
    }
    tl_assert( VG_(sizeXA)( mce.tmpMap ) == sb_in->tyenv->types_used );
@@ -6470,6 +6732,7 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
          IRTemp tmp_v = findShadowTmpV(&mce, tmp_o);
          IRType ty_v  = typeOfIRTemp(sb_out->tyenv, tmp_v);
          assign( 'V', &mce, tmp_v, definedOfType( ty_v ) );
+         setShadowTmpVDefined(&mce, tmp_o);
          if (MC_(clo_mc_level) == 3) {
             IRTemp tmp_b = findShadowTmpB(&mce, tmp_o);
             tl_assert(typeOfIRTemp(sb_out->tyenv, tmp_b) == Ity_I32);
@@ -6512,6 +6775,17 @@ IRSB* MC_(instrument) ( VgCallbackClosure* closure,
       switch (st->tag) {
 
          case Ist_WrTmp:
+            /* If the value is computed only from known-defined
+               values, skip generating the V bit computation, and
+               remember that the tmp is defined. */
+            if (isDefinedExpr(&mce, st->Ist.WrTmp.data)) {
+               IRTemp tmp = st->Ist.WrTmp.tmp;
+               assign( 'V', &mce, findShadowTmpV(&mce, tmp),
+                       definedOfType(
+                          shadowTypeV(typeOfIRTemp(sb_out->tyenv, tmp))) );
+               setShadowTmpVDefined(&mce, tmp);
+               break;
+            }
             assign( 'V', &mce, findShadowTmpV(&mce, st->Ist.WrTmp.tmp), 
                                expr2vbits( &mce, st->Ist.WrTmp.data) );
             break;
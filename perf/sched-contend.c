@@ -0,0 +1,71 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+// sched-contend starts many threads that are all runnable at the same
+// time, and that each do a cheap system call every few hundred
+// iterations.  Every such syscall makes the thread give up and then
+// re-acquire the Valgrind scheduler lock, so the run time is dominated
+// by the cost of handing the lock over between threads.  It is meant
+// to compare the scheduler lock implementations, e.g. with
+// --fair-sched=no|yes|queue.
+
+static int nr_thr   = 32;     // nr of threads
+static int nr_loops = 200000; // nr of loops per thread
+static int nr_work  = 200;    // nr of loops between two syscalls
+
+static volatile unsigned long sink;
+
+static void *contend_fn(void *v)
+{
+   int loops;
+   unsigned long acc = (unsigned long)v;
+
+   for (loops = 0; loops < nr_loops; loops++) {
+      acc = acc * 6364136223846793005UL + 1442695040888963407UL;
+      if (loops % nr_work == 0)
+         acc += getppid();
+   }
+   sink += acc;
+   return NULL;
+}
+
+int main (int argc, char *argv[])
+{
+   int a;
+   int i;
+   pthread_t *thr;
+
+   // usage: sched-contend [-t nr_thr default 32]
+   //                      [-l nr_loops default 200000]
+   //                      [-w nr_work default 200]
+   while ((a = getopt(argc, argv, "t:l:w:")) != -1) {
+      switch (a) {
+      case 't': nr_thr   = atoi(optarg); break;
+      case 'l': nr_loops = atoi(optarg); break;
+      case 'w': nr_work  = atoi(optarg); break;
+      default:
+         fprintf(stderr, "usage: sched-contend [-t nr_thr] [-l nr_loops]"
+                 " [-w nr_work]\n");
+         exit(1);
+      }
+   }
+   if (nr_thr < 1 || nr_work < 1) {
+      fprintf(stderr, "sched-contend: bad arguments\n");
+      exit(1);
+   }
+
+   thr = malloc(nr_thr * sizeof(pthread_t));
+   for (i = 0; i < nr_thr; i++) {
+      if (pthread_create(&thr[i], NULL, contend_fn, (void*)(long)i) != 0) {
+         perror("pthread_create");
+         exit(1);
+      }
+   }
+   for (i = 0; i < nr_thr; i++)
+      pthread_join(thr[i], NULL);
+   free(thr);
+   return 0;
+}
@@ -0,0 +1,57 @@
+// This artificial program moves around the V+A bits of large blocks of
+// memory.  It is a stress test for Memcheck's bulk shadow memory
+// operations: set_address_range_perms (mmap, munmap, malloc, free),
+// copy_address_range_state (realloc, mremap) and is_mem_defined (checking
+// the buffer passed to write()).
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define REPS     200
+#define MB       (1024 * 1024)
+
+int main(void)
+{
+   int   i, fd, sum = 0;
+   char* p;
+   char* q;
+
+   fd = open("/dev/null", O_WRONLY);
+   assert(fd >= 0);
+
+   for (i = 0; i < REPS; i++) {
+      // A defined block, a mostly defined one and an undefined one get
+      // moved around by realloc.
+      p = malloc(4 * MB);
+      memset(p, i, 4 * MB);
+      p = realloc(p, 8 * MB);
+      memset(p + 4 * MB, i, 4 * MB - 3);
+      p = realloc(p, 12 * MB);
+      // write() checks that the whole buffer is defined.
+      sum += write(fd, p, 8 * MB - 3) > 0;
+      sum += p[4 * MB - 1];
+      free(p);
+
+      // Large mappings that are only partly written to.
+      q = mmap(NULL, 16 * MB, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      assert(q != MAP_FAILED);
+      memset(q + 3 * MB + 1, 1, 5 * MB);
+#if defined(MREMAP_MAYMOVE)
+      q = mremap(q, 16 * MB, 32 * MB, MREMAP_MAYMOVE);
+      assert(q != MAP_FAILED);
+      sum += write(fd, q, 16 * MB) > 0;
+      munmap(q, 32 * MB);
+#else
+      sum += write(fd, q, 16 * MB) > 0;
+      munmap(q, 16 * MB);
+#endif
+   }
+   close(fd);
+   return sum == 0xdeadbeef ? 1 : 0;
+}